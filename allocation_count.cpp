@@ -0,0 +1,33 @@
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include "allocation_count.h"
+
+static std::atomic<unsigned long> allocations(0);
+
+unsigned long allocation_count()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+    void *memory = malloc(size ? size : 1);
+
+    if(!memory)
+        throw std::bad_alloc();
+
+    return memory;
+}
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
@@ -0,0 +1,16 @@
+/*************************************************************************************************************
+ * Allocation Count                                                                                          *
+ *                                                                                                           *
+ * Counts every allocation made with new, on any thread, by replacing the global operator new (and delete).  *
+ * It's there for the self-test, which checks that evolution stops allocating memory once it is under way.   *
+ *                                                                                                           *
+ *      -Counting is a single relaxed atomic increment, which costs next to nothing next to allocating.      *
+ *      -Memory comes from malloc(), as it does with the standard operator new.                              *
+ ************************************************************************************************************/
+
+#ifndef ALLOCATION_COUNT_H
+#define ALLOCATION_COUNT_H
+
+unsigned long allocation_count();  // How many times memory has been allocated with new so far.
+
+#endif
@@ -0,0 +1,309 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "population.h"
+#include "fitness_cache.h"
+#include "checkpoint.h"
+
+static const char MAGIC[8] = {'B', 'F', 'E', 'V', 'O', 'C', 'K', 'P'};
+static const uint32_t VERSION = 1;  // Goes up whenever the format changes, so old checkpoints are turned away.
+
+/* The start of every checkpoint. After it come the options (each a 32-bit length and then its characters), the
+   length of every program (32 bits each), every score, the programs one after another, and then the fitness cache. */
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t population_size;
+    uint32_t max_program_size;
+    uint32_t num_options;
+    uint64_t generations;
+    uint64_t random_state[4];
+    uint32_t elite_cycles;
+    uint32_t keep_going;
+    uint64_t options_size;  // The size in bytes of the sections that don't follow from the population size.
+    uint64_t programs_size;
+    uint64_t cache_size;
+};
+
+template <typename T>
+static void append(std::vector<char> &buffer, const T &value)
+{
+    buffer.insert(buffer.end(), reinterpret_cast<const char *>(&value), reinterpret_cast<const char *>(&value + 1));
+}
+
+// The file's contents might not be aligned for T, so it is copied out rather than pointed to.
+template <typename T>
+static T read_at(const char *data, size_t index = 0)
+{
+    T value;
+    memcpy(&value, data + index * sizeof(T), sizeof(T));
+
+    return value;
+}
+
+CheckpointWriter::CheckpointWriter(const std::string &filename) : filename(filename), pending(false), stopping(false)
+{
+    this->thread = std::thread(&CheckpointWriter::thread_main, this);
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->write_lock);
+        this->stopping = true;
+    }
+
+    this->wake.notify_one();
+    this->thread.join();
+}
+
+bool CheckpointWriter::save(const RunState &run, const Population &population, const FitnessCache &cache)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->write_lock);
+
+        if(this->pending)
+            return false;
+    }
+
+    Header header;
+    size_t programs_size = 0;
+
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.population_size = population.size();
+    header.max_program_size = population.max_length();
+    header.num_options = run.options.size();
+    header.generations = run.generations;
+    memcpy(header.random_state, run.random_state, sizeof(header.random_state));
+    header.elite_cycles = run.elite_cycles;
+    header.keep_going = run.keep_going;
+
+    // Header first, with the section sizes filled in once they're known.
+    this->buffer.assign(sizeof(header), 0);
+
+    for(size_t i = 0; i < run.options.size(); ++i)
+    {
+        append(this->buffer, static_cast<uint32_t>(run.options[i].length()));
+        this->buffer.insert(this->buffer.end(), run.options[i].begin(), run.options[i].end());
+    }
+
+    header.options_size = this->buffer.size() - sizeof(header);
+
+    for(unsigned id = 0; id < population.size(); ++id)
+        append(this->buffer, static_cast<uint32_t>(population.length(id)));
+
+    for(unsigned id = 0; id < population.size(); ++id)
+        append(this->buffer, population.score(id));
+
+    for(unsigned id = 0; id < population.size(); ++id)
+    {
+        this->buffer.insert(this->buffer.end(), population.program(id), population.program(id) + population.length(id));
+        programs_size += population.length(id);
+    }
+
+    header.programs_size = programs_size;
+
+    size_t cache_start = this->buffer.size();
+    cache.save(this->buffer);
+    header.cache_size = this->buffer.size() - cache_start;
+
+    memcpy(&this->buffer[0], &header, sizeof(header));
+
+    {
+        std::lock_guard<std::mutex> lock(this->write_lock);
+        this->pending = true;
+    }
+
+    this->wake.notify_one();
+
+    return true;
+}
+
+void CheckpointWriter::thread_main()
+{
+    std::unique_lock<std::mutex> lock(this->write_lock);
+
+    while(1)
+    {
+        while(!this->pending && !this->stopping)
+            this->wake.wait(lock);
+
+        if(!this->pending)
+            return;
+
+        // save() won't touch the buffer while it's pending, so it can be written without holding the lock.
+        lock.unlock();
+
+        if(!this->write_file())
+            std::cerr << "Couldn't write checkpoint '" << this->filename << "'" << std::endl;
+
+        lock.lock();
+        this->pending = false;
+    }
+}
+
+// Writes the buffer to a temporary file, then puts that in place of the last checkpoint in one step.
+bool CheckpointWriter::write_file()
+{
+    std::string temporary = this->filename + ".tmp";
+
+    {
+        std::ofstream file(temporary.c_str(), std::ios::binary | std::ios::trunc);
+
+        if(!file.write(&this->buffer[0], this->buffer.size()) || !file.flush())
+            return false;
+    }
+
+    return std::rename(temporary.c_str(), this->filename.c_str()) == 0;
+}
+
+CheckpointReader::CheckpointReader()
+    : data(NULL), size(0), population_size(0), max_program_size(0), lengths(NULL), scores(NULL), programs(NULL), cache(NULL),
+      cache_size(0)
+{
+}
+
+CheckpointReader::~CheckpointReader()
+{
+    this->close();
+}
+
+void CheckpointReader::close()
+{
+    if(this->data)
+        munmap(const_cast<char *>(this->data), this->size);
+
+    this->data = NULL;
+    this->size = 0;
+}
+
+bool CheckpointReader::open(const std::string &filename)
+{
+    this->close();
+
+    int file = ::open(filename.c_str(), O_RDONLY);
+    struct stat info;
+
+    if(file < 0)
+        return false;
+
+    if(fstat(file, &info) < 0 || static_cast<size_t>(info.st_size) < sizeof(Header))
+    {
+        ::close(file);
+        return false;
+    }
+
+    void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    ::close(file);  // The mapping stays after the file is closed.
+
+    if(mapping == MAP_FAILED)
+        return false;
+
+    this->data = static_cast<const char *>(mapping);
+    this->size = info.st_size;
+
+    Header header = read_at<Header>(this->data);
+    uint64_t population_size = header.population_size;
+
+    // Everything past the header has to be exactly the sections it describes.
+    if(memcmp(header.magic, MAGIC, sizeof(MAGIC)) || header.version != VERSION ||
+       header.options_size + population_size * (sizeof(uint32_t) + sizeof(double)) + header.programs_size + header.cache_size !=
+       this->size - sizeof(Header))
+    {
+        this->close();
+        return false;
+    }
+
+    const char *pntr = this->data + sizeof(Header);
+    const char *options_end = pntr + header.options_size;
+
+    this->run_state = RunState();
+
+    for(uint32_t i = 0; i < header.num_options; ++i)
+    {
+        if(options_end - pntr < static_cast<ptrdiff_t>(sizeof(uint32_t)))
+        {
+            this->close();
+            return false;
+        }
+
+        uint32_t length = read_at<uint32_t>(pntr);
+        pntr += sizeof(length);
+
+        if(static_cast<size_t>(options_end - pntr) < length)
+        {
+            this->close();
+            return false;
+        }
+
+        this->run_state.options.push_back(std::string(pntr, length));
+        pntr += length;
+    }
+
+    this->run_state.generations = header.generations;
+    memcpy(this->run_state.random_state, header.random_state, sizeof(header.random_state));
+    this->run_state.elite_cycles = header.elite_cycles;
+    this->run_state.keep_going = header.keep_going;
+
+    this->population_size = header.population_size;
+    this->max_program_size = header.max_program_size;
+    this->lengths = options_end;
+    this->scores = this->lengths + population_size * sizeof(uint32_t);
+    this->programs = this->scores + population_size * sizeof(double);
+    this->cache = this->programs + header.programs_size;
+    this->cache_size = header.cache_size;
+
+    return true;
+}
+
+const RunState &CheckpointReader::run() const
+{
+    return this->run_state;
+}
+
+bool CheckpointReader::restore(Population &population, FitnessCache &cache) const
+{
+    if(!this->data || population.size() != this->population_size || population.max_length() != this->max_program_size)
+        return false;
+
+    // Make sure the programs add up to the section they're in before copying any of them.
+    uint64_t programs_size = 0;
+
+    for(unsigned id = 0; id < this->population_size; ++id)
+    {
+        uint32_t length = read_at<uint32_t>(this->lengths, id);
+
+        if(length > this->max_program_size)
+            return false;
+
+        programs_size += length;
+    }
+
+    if(this->programs + programs_size != this->cache || !cache.load(this->cache, this->cache_size))
+        return false;
+
+    const char *program = this->programs;
+
+    for(unsigned id = 0; id < this->population_size; ++id)
+    {
+        uint32_t length = read_at<uint32_t>(this->lengths, id);
+
+        population.set_program(id, program, length);
+        population.set_score(id, read_at<double>(this->scores, id));
+        program += length;
+    }
+
+    population.clear_unscored();
+
+    return true;
+}
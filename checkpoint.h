@@ -0,0 +1,110 @@
+/*************************************************************************************************************
+ * Checkpoint                                                                                                *
+ *                                                                                                           *
+ * Saves a run to a file every so often, so that it can be carried on later from where it was saved. With a  *
+ * fixed seed, a resumed run goes exactly as it would have if it had never stopped.                          *
+ *                                                                                                           *
+ *      -A checkpoint holds the options the run was started with, the generation it got to, the state of its *
+ *       random numbers, and every program in the population along with its score, as well as the fitness    *
+ *       cache. Snapshots aren't saved, since they only make scoring faster and never change a score.        *
+ *      -Saving only copies all that into a buffer. The file is written on a thread of its own, to a         *
+ *       temporary file that then replaces the last checkpoint, so a run stopped partway through a write     *
+ *       still has that one.                                                                                 *
+ *      -If the last checkpoint is still being written when the next is due, the next one is skipped rather  *
+ *       than holding up evolution.                                                                          *
+ *      -Checkpoints are read back by mapping the file into memory and copying the programs straight out.    *
+ *      -The file starts with "BFEVOCKP" and a version number. Numbers are stored as they are in memory, so  *
+ *       a checkpoint can only be resumed on the same kind of machine that saved it.                         *
+ *************************************************************************************************************/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include "population.h"
+#include "fitness_cache.h"
+
+// Everything about a run besides its population and cache.
+struct RunState
+{
+    std::vector<std::string> options;  // The command line options the run was started with, to start it the same way again.
+    unsigned long generations;
+    uint64_t random_state[4];
+    unsigned elite_cycles;  // The cycles the best program needed, which the first cycle tier's budget is based on.
+    bool keep_going;  // Whether the user chose to keep evolving once the goal was reached.
+
+    RunState() : generations(0), elite_cycles(0), keep_going(false) {}
+};
+
+class CheckpointWriter
+{
+private:
+    std::string filename;
+    std::vector<char> buffer;  // The checkpoint to write. Only touched by save() while the thread isn't writing it.
+
+    std::mutex write_lock;  // Guards everything below.
+    std::condition_variable wake;
+    bool pending;  // Set while the buffer holds a checkpoint the thread hasn't finished writing.
+    bool stopping;  // Set when the writer is destroyed, to tell the thread to exit.
+    std::thread thread;
+
+    void thread_main();  // Writes out each checkpoint it is handed until the writer is destroyed.
+    bool write_file();
+
+    // Threads and mutexes can't be copied.
+    CheckpointWriter(const CheckpointWriter &other);
+    CheckpointWriter &operator=(const CheckpointWriter &other);
+
+public:
+    explicit CheckpointWriter(const std::string &filename);
+    ~CheckpointWriter();  // Finishes writing the last checkpoint first, if it's still being written.
+
+    /* Copies the run into a checkpoint and hands it to the thread to write. Every program must have been scored.
+       Returns false (saving nothing) if the last checkpoint is still being written. */
+    bool save(const RunState &run, const Population &population, const FitnessCache &cache);
+
+};
+
+class CheckpointReader
+{
+private:
+    const char *data;  // The whole file, mapped into memory. NULL until a checkpoint is opened.
+    size_t size;
+
+    RunState run_state;
+    unsigned population_size;
+    unsigned max_program_size;
+
+    // Where each section of the file starts.
+    const char *lengths;
+    const char *scores;
+    const char *programs;
+    const char *cache;
+    size_t cache_size;
+
+    void close();
+
+    // The mapping belongs to one reader.
+    CheckpointReader(const CheckpointReader &other);
+    CheckpointReader &operator=(const CheckpointReader &other);
+
+public:
+    CheckpointReader();
+    ~CheckpointReader();
+
+    bool open(const std::string &filename);  // False if the file can't be read, or isn't a checkpoint of this version.
+
+    const RunState &run() const;
+
+    /* Puts the saved programs, scores and cache back, with every program left scored. The population and cache must be
+       the same sizes as the ones saved (which they are when made with the saved options). Returns false if they aren't. */
+    bool restore(Population &population, FitnessCache &cache) const;
+
+};
+
+#endif
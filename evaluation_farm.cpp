@@ -0,0 +1,303 @@
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "interpreter.h"
+#include "population.h"
+#include "evaluation_pool.h"
+#include "evaluation_farm.h"
+
+// Keeps reading until all of length has been read. False if the other end closed its socket (or died) first.
+static bool read_all(int socket, void *data, size_t length)
+{
+    char *pntr = static_cast<char *>(data);
+
+    while(length)
+    {
+        ssize_t got = read(socket, pntr, length);
+
+        if(got < 0 && errno == EINTR)
+            continue;
+        if(got <= 0)
+            return false;
+
+        pntr += got;
+        length -= got;
+    }
+
+    return true;
+}
+
+// Keeps writing until all of length has been written. False if the other end has gone. Never raises SIGPIPE.
+static bool write_all(int socket, const void *data, size_t length)
+{
+    const char *pntr = static_cast<const char *>(data);
+
+    while(length)
+    {
+        ssize_t sent = send(socket, pntr, length, MSG_NOSIGNAL);
+
+        if(sent < 0 && errno == EINTR)
+            continue;
+        if(sent <= 0)
+            return false;
+
+        pntr += sent;
+        length -= sent;
+    }
+
+    return true;
+}
+
+EvaluationFarm::EvaluationFarm(unsigned num_workers, Interpreter::Backend backend, EvaluationPool::Evaluator eval)
+    : evaluator(eval), interpreter(backend)
+{
+    // Anything still buffered would otherwise be written out again by every worker.
+    std::cout.flush();
+    std::cerr.flush();
+
+    for(unsigned i = 0; i < num_workers; ++i)
+    {
+        int sockets[2];
+
+        if(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0)
+            break;
+
+        pid_t pid = fork();
+
+        if(pid < 0)
+        {
+            close(sockets[0]);
+            close(sockets[1]);
+            break;
+        }
+
+        if(!pid)
+        {
+            // The worker only needs its own end of its own socket.
+            for(size_t j = 0; j < this->workers.size(); ++j)
+                close(this->workers[j].socket);
+
+            close(sockets[0]);
+            this->worker_main(sockets[1]);
+        }
+
+        close(sockets[1]);
+
+        Worker worker;
+        worker.pid = pid;
+        worker.socket = sockets[0];
+        this->workers.push_back(worker);
+    }
+}
+
+EvaluationFarm::~EvaluationFarm()
+{
+    // Closing a worker's socket is its signal to exit.
+    for(size_t i = 0; i < this->workers.size(); ++i)
+        close(this->workers[i].socket);
+
+    for(size_t i = 0; i < this->workers.size(); ++i)
+        waitpid(this->workers[i].pid, NULL, 0);
+}
+
+void EvaluationFarm::worker_main(int socket)
+{
+    std::vector<Interpreter::Snapshot> snapshots;
+    std::vector<char> program;
+    ChunkHeader header;
+
+    while(read_all(socket, &header, sizeof(header)))
+    {
+        this->results.resize(header.count);
+
+        for(uint32_t i = 0; i < header.count; ++i)
+        {
+            Result &result = this->results[i];
+            uint32_t length;
+
+            if(!read_all(socket, &result.id, sizeof(result.id)) || !read_all(socket, &length, sizeof(length)))
+                _exit(1);
+
+            program.resize(length);
+
+            if(length && !read_all(socket, &program[0], length))
+                _exit(1);
+
+            if(result.id >= snapshots.size())
+                snapshots.resize(result.id + 1);
+
+            Interpreter::Snapshot &snapshot = snapshots[result.id];
+
+            result.score = this->evaluator(length ? &program[0] : "", length, header.cutoff, header.max_cycles,
+                                           this->interpreter, snapshot);
+            result.cycles = snapshot.cycles;
+            result.max_cycles = snapshot.max_cycles;
+            result.out_of_cycles = snapshot.out_of_cycles;
+        }
+
+        if(header.count && !write_all(socket, &this->results[0], header.count * sizeof(Result)))
+            break;
+    }
+
+    // Skips the destructors and exit handlers, which belong to the coordinator.
+    _exit(0);
+}
+
+void EvaluationFarm::evaluate(double cutoff, unsigned max_cycles, Population &population, const std::vector<unsigned> &jobs)
+{
+    std::deque<Chunk> queue;
+    std::vector<pollfd> polls;
+
+    if(this->workers.empty() || jobs.size() < MIN_BATCH)
+        queue.push_back(Chunk(0, jobs.size()));
+    else
+    {
+        for(size_t first = 0; first < jobs.size(); first += CHUNK_SIZE)
+            queue.push_back(Chunk(first, std::min<size_t>(first + CHUNK_SIZE, jobs.size())));
+    }
+
+    while(!this->workers.empty() && jobs.size() >= MIN_BATCH)
+    {
+        // Top every worker back up with chunks.
+        for(size_t i = 0; i < this->workers.size(); ++i)
+        {
+            Worker &worker = this->workers[i];
+
+            while(!queue.empty() && worker.chunks.size() < CHUNKS_AHEAD)
+            {
+                worker.chunks.push_back(queue.front());
+                queue.pop_front();
+
+                if(!this->send_chunk(worker, worker.chunks.back(), cutoff, max_cycles, population, jobs))
+                {
+                    this->lose_worker(i--, queue);
+                    break;
+                }
+            }
+        }
+
+        // Wait for scores from whichever workers have chunks out.
+        polls.clear();
+
+        for(size_t i = 0; i < this->workers.size(); ++i)
+        {
+            pollfd poll_socket = {this->workers[i].socket, POLLIN, 0};
+
+            if(!this->workers[i].chunks.empty())
+                polls.push_back(poll_socket);
+        }
+
+        if(polls.empty())
+            break;
+
+        if(poll(&polls[0], polls.size(), -1) < 0)
+        {
+            if(errno == EINTR)
+                continue;
+
+            // Nothing can be heard from the workers any more, so it's down to the coordinator.
+            while(!this->workers.empty())
+                this->lose_worker(0, queue);
+
+            break;
+        }
+
+        // polls is in the same order as the workers, and losing a worker only moves the ones after it back by one.
+        for(size_t p = 0, i = 0; p < polls.size(); ++p)
+        {
+            while(this->workers[i].socket != polls[p].fd)
+                ++i;
+
+            if(polls[p].revents && !this->receive_scores(this->workers[i], population))
+                this->lose_worker(i, queue);
+        }
+    }
+
+    // Whatever is left (a small batch, or the rest of one every worker died partway through) is scored right here.
+    for(; !queue.empty(); queue.pop_front())
+    {
+        for(size_t i = queue.front().first; i < queue.front().second; ++i)
+        {
+            unsigned id = jobs[i];
+
+            population.scores()[id] = this->evaluator(population.program(id), population.length(id), cutoff, max_cycles,
+                                                      this->interpreter, population.snapshot(id));
+        }
+    }
+}
+
+bool EvaluationFarm::send_chunk(Worker &worker, const Chunk &chunk, double cutoff, unsigned max_cycles, Population &population,
+                                const std::vector<unsigned> &jobs)
+{
+    ChunkHeader header = {static_cast<uint32_t>(chunk.second - chunk.first), max_cycles, cutoff};
+
+    this->message.assign(reinterpret_cast<const char *>(&header), reinterpret_cast<const char *>(&header + 1));
+
+    for(size_t i = chunk.first; i < chunk.second; ++i)
+    {
+        uint32_t id = jobs[i];
+        uint32_t length = population.length(id);
+
+        this->message.insert(this->message.end(), reinterpret_cast<const char *>(&id), reinterpret_cast<const char *>(&id + 1));
+        this->message.insert(this->message.end(), reinterpret_cast<const char *>(&length), reinterpret_cast<const char *>(&length + 1));
+        this->message.insert(this->message.end(), population.program(id), population.program(id) + length);
+    }
+
+    return write_all(worker.socket, &this->message[0], this->message.size());
+}
+
+// Reads the scores for the worker's oldest chunk. False if the worker died before sending them all.
+bool EvaluationFarm::receive_scores(Worker &worker, Population &population)
+{
+    size_t count = worker.chunks.front().second - worker.chunks.front().first;
+
+    this->results.resize(count);
+
+    if(!read_all(worker.socket, &this->results[0], count * sizeof(Result)))
+        return false;
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        const Result &result = this->results[i];
+        Interpreter::Snapshot &snapshot = population.snapshot(result.id);
+
+        population.scores()[result.id] = result.score;
+        snapshot.cycles = result.cycles;
+        snapshot.max_cycles = result.max_cycles;
+        snapshot.out_of_cycles = result.out_of_cycles;
+    }
+
+    worker.chunks.pop_front();
+
+    return true;
+}
+
+void EvaluationFarm::lose_worker(size_t index, std::deque<Chunk> &queue)
+{
+    Worker &worker = this->workers[index];
+
+    std::cerr << "Evaluation worker " << worker.pid << " died, handing its work to the others." << std::endl;
+
+    queue.insert(queue.begin(), worker.chunks.begin(), worker.chunks.end());
+
+    close(worker.socket);
+    kill(worker.pid, SIGKILL);
+    waitpid(worker.pid, NULL, 0);
+
+    this->workers.erase(this->workers.begin() + index);
+}
+
+unsigned EvaluationFarm::size() const
+{
+    return this->workers.size();
+}
@@ -0,0 +1,96 @@
+/*************************************************************************************************************
+ * Evaluation Farm                                                                                           *
+ *                                                                                                           *
+ * Scores batches of programs in worker processes, each with its own brainfuck interpreter, for populations  *
+ * big enough that one process's threads can't keep up. The coordinator talks to each worker over a Unix     *
+ * domain socket of its own.                                                                                 *
+ *                                                                                                           *
+ *      -Workers are forked from the coordinator when the farm is made, so they already know everything it   *
+ *       does (the goal output, test cases and settings), and only programs and scores are ever sent.        *
+ *      -Each batch is sent in chunks, and every worker is kept a couple of chunks ahead, so it always has   *
+ *       the next one waiting by the time it sends back the scores for the last.                             *
+ *      -A worker that dies has the chunks it was working on handed to the others. If every worker dies,     *
+ *       the coordinator scores whatever is left itself.                                                     *
+ *      -Batches too small to be worth a round trip are scored by the coordinator straight away.             *
+ *      -Each worker keeps its own snapshots, by program ID. A program's score only depends on the program,  *
+ *       so scores are the same wherever it is scored, just like with the evaluation pool.                   *
+ *************************************************************************************************************/
+
+#ifndef EVALUATION_FARM_H
+#define EVALUATION_FARM_H
+
+#include <vector>
+#include <deque>
+#include <utility>
+#include <stdint.h>
+#include <sys/types.h>
+#include "interpreter.h"
+#include "population.h"
+#include "evaluation_pool.h"
+
+class EvaluationFarm
+{
+private:
+    static const unsigned CHUNK_SIZE = 64;  // The most programs sent to a worker in one go.
+    static const unsigned CHUNKS_AHEAD = 2;  // How many chunks each worker is sent before it has to send any scores back.
+    static const unsigned MIN_BATCH = 32;  // Batches smaller than this are scored by the coordinator.
+
+    // Sent ahead of every chunk, followed by each program's ID, length and source.
+    struct ChunkHeader
+    {
+        uint32_t count;
+        uint32_t max_cycles;
+        double cutoff;
+    };
+
+    // Sent back for every program in a chunk, in the same order. The rest of it is copied into the program's snapshot.
+    struct Result
+    {
+        uint32_t id;
+        uint32_t cycles;
+        uint32_t max_cycles;
+        uint32_t out_of_cycles;
+        double score;
+    };
+
+    typedef std::pair<size_t, size_t> Chunk;  // The range of the batch's jobs a chunk holds.
+
+    struct Worker
+    {
+        pid_t pid;
+        int socket;
+        std::deque<Chunk> chunks;  // The chunks sent to it that it hasn't sent the scores back for yet, oldest first.
+    };
+
+    EvaluationPool::Evaluator evaluator;
+    std::vector<Worker> workers;
+    Interpreter interpreter;  // Scores programs on the coordinator, when they aren't worth sending.
+    std::vector<char> message;  // The chunk being sent, kept so sending doesn't allocate.
+    std::vector<Result> results;  // The scores being received.
+
+    void worker_main(int socket);  // What a worker process runs. Never returns.
+    bool send_chunk(Worker &worker, const Chunk &chunk, double cutoff, unsigned max_cycles, Population &population,
+                    const std::vector<unsigned> &jobs);
+    bool receive_scores(Worker &worker, Population &population);
+    void lose_worker(size_t index, std::deque<Chunk> &queue);  // Hands a dead worker's chunks back to the queue.
+
+    // Child processes can't be copied.
+    EvaluationFarm(const EvaluationFarm &other);
+    EvaluationFarm &operator=(const EvaluationFarm &other);
+
+public:
+    /* Forks num_workers worker processes, which score programs with eval. This has to happen before the coordinator
+       starts any threads, which the workers wouldn't get copies of. */
+    EvaluationFarm(unsigned num_workers, Interpreter::Backend backend, EvaluationPool::Evaluator eval);
+    ~EvaluationFarm();  // Tells the workers to exit, and waits for them.
+
+    /* Scores every program in the population whose ID is in jobs, and returns once all of them are done, the same
+       way EvaluationPool::evaluate() does. Each program's snapshot is only updated with how its run ended, since the
+       checkpoints stay with whichever worker ran it. */
+    void evaluate(double cutoff, unsigned max_cycles, Population &population, const std::vector<unsigned> &jobs);
+
+    unsigned size() const;  // The number of workers still alive.
+
+};
+
+#endif
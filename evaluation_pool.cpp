@@ -0,0 +1,164 @@
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "interpreter.h"
+#include "population.h"
+#include "evaluation_pool.h"
+
+EvaluationPool::Worker::Worker(Interpreter::Backend backend) : interpreter(backend), first_job(0)
+{
+}
+
+EvaluationPool::EvaluationPool(unsigned num_threads, Interpreter::Backend backend)
+    : evaluator(NULL), cutoff(0), max_cycles(0), population(NULL), batch_number(0), busy_threads(0), stopping(false)
+{
+    if(!num_threads)
+        num_threads = 1;
+
+    for(unsigned i = 0; i < num_threads; ++i)
+        this->workers.push_back(new Worker(backend));
+
+    for(unsigned i = 1; i < num_threads; ++i)
+        this->workers[i]->thread = std::thread(&EvaluationPool::thread_main, this, i);
+}
+
+EvaluationPool::~EvaluationPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->batch_lock);
+        this->stopping = true;
+    }
+
+    this->batch_started.notify_all();
+
+    for(size_t i = 0; i < this->workers.size(); ++i)
+    {
+        if(this->workers[i]->thread.joinable())
+            this->workers[i]->thread.join();
+
+        delete this->workers[i];
+    }
+}
+
+void EvaluationPool::evaluate(Evaluator eval, double cutoff, unsigned max_cycles, Population &population, const std::vector<unsigned> &jobs)
+{
+    this->evaluator = eval;
+    this->cutoff = cutoff;
+    this->max_cycles = max_cycles;
+    this->population = &population;
+
+    // There's no point waking the other threads for a single program.
+    if(this->workers.size() == 1 || jobs.size() <= 1)
+    {
+        for(size_t i = 0; i < jobs.size(); ++i)
+            this->score(this->workers[0]->interpreter, jobs[i]);
+
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(this->batch_lock);
+
+    // Deal the jobs out like cards, so each worker gets programs from all over the population.
+    for(size_t i = 0; i < this->workers.size(); ++i)
+    {
+        std::lock_guard<std::mutex> jobs_lock(this->workers[i]->jobs_lock);
+
+        this->workers[i]->jobs.clear();
+        this->workers[i]->first_job = 0;
+    }
+
+    for(size_t i = 0; i < jobs.size(); ++i)
+    {
+        Worker *worker = this->workers[i % this->workers.size()];
+        std::lock_guard<std::mutex> jobs_lock(worker->jobs_lock);
+
+        worker->jobs.push_back(jobs[i]);
+    }
+
+    this->busy_threads = this->workers.size() - 1;
+    ++this->batch_number;
+    lock.unlock();
+
+    this->batch_started.notify_all();
+    this->work(0);
+
+    lock.lock();
+    while(this->busy_threads)
+        this->batch_finished.wait(lock);
+}
+
+unsigned EvaluationPool::size() const
+{
+    return this->workers.size();
+}
+
+void EvaluationPool::thread_main(unsigned id)
+{
+    unsigned long last_batch = 0;
+
+    while(1)
+    {
+        {
+            std::unique_lock<std::mutex> lock(this->batch_lock);
+
+            while(!this->stopping && this->batch_number == last_batch)
+                this->batch_started.wait(lock);
+
+            if(this->stopping)
+                return;
+
+            last_batch = this->batch_number;
+        }
+
+        this->work(id);
+
+        std::lock_guard<std::mutex> lock(this->batch_lock);
+        if(!--this->busy_threads)
+            this->batch_finished.notify_one();
+    }
+}
+
+void EvaluationPool::work(unsigned id)
+{
+    Interpreter &bf = this->workers[id]->interpreter;
+    unsigned index;
+
+    while(this->take_job(id, index))
+        this->score(bf, index);
+}
+
+void EvaluationPool::score(Interpreter &bf, unsigned id)
+{
+    Population &population = *this->population;
+
+    population.scores()[id] = this->evaluator(population.program(id), population.length(id), this->cutoff, this->max_cycles, bf,
+                                              population.snapshot(id));
+}
+
+/* A worker takes its own jobs from the back, and steals other workers' jobs from the front,
+   so that a thief and the worker it steals from only meet on the very last job. */
+bool EvaluationPool::take_job(unsigned id, unsigned &index)
+{
+    for(size_t i = 0; i < this->workers.size(); ++i)
+    {
+        Worker *worker = this->workers[(id + i) % this->workers.size()];
+        std::lock_guard<std::mutex> lock(worker->jobs_lock);
+
+        if(worker->first_job == worker->jobs.size())
+            continue;
+
+        if(i == 0)
+        {
+            index = worker->jobs.back();
+            worker->jobs.pop_back();
+        }
+        else
+            index = worker->jobs[worker->first_job++];
+
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,85 @@
+/*************************************************************************************************************
+ * Evaluation Pool                                                                                           *
+ *                                                                                                           *
+ * Scores a batch of programs across several threads, each with its own brainfuck interpreter.               *
+ *                                                                                                           *
+ *      -The thread asking for a batch to be scored works on it too, so a pool of 1 starts no threads at all. *
+ *      -Every thread is dealt an even share of the batch up front. A thread that runs out of work steals     *
+ *       from the others, since programs range from a few cycles (errors) to the whole cycle limit.          *
+ *      -A program's score only depends on the program itself, so which thread happens to run it doesn't      *
+ *       matter. Results are the same whatever the number of threads.                                        *
+ *************************************************************************************************************/
+
+#ifndef EVALUATION_POOL_H
+#define EVALUATION_POOL_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "interpreter.h"
+#include "population.h"
+
+class EvaluationPool
+{
+public:
+    /* Scores a single program with the interpreter of whichever thread runs it, resuming from its snapshot.
+       A program that can't score at least the cutoff may be stopped early, and given any score below it.
+       A program may also be stopped once it has run for max_cycles, which the snapshot records. */
+    typedef double (*Evaluator)(const char *program, unsigned length, double cutoff, unsigned max_cycles, Interpreter &bf,
+                                Interpreter::Snapshot &snapshot);
+
+private:
+    struct Worker
+    {
+        Interpreter interpreter;
+        // The IDs of the programs this worker was dealt. The ones from first_job up to the end are still to be scored.
+        std::vector<unsigned> jobs;
+        size_t first_job;
+        std::mutex jobs_lock;
+        std::thread thread;  // Not started for worker 0, which is whoever calls evaluate().
+
+        explicit Worker(Interpreter::Backend backend);
+    };
+
+    std::vector<Worker *> workers;
+
+    // The batch currently being scored.
+    Evaluator evaluator;
+    double cutoff;
+    unsigned max_cycles;
+    Population *population;
+
+    std::mutex batch_lock;  // Guards everything below.
+    std::condition_variable batch_started;
+    std::condition_variable batch_finished;
+    unsigned long batch_number;  // Counts batches, so the threads can tell when a new one has started.
+    unsigned busy_threads;  // The number of threads that haven't finished with the current batch yet.
+    bool stopping;  // Set when the pool is destroyed, to tell the threads to exit.
+
+    void thread_main(unsigned id);  // Waits for batches and helps score them until the pool is destroyed.
+    void work(unsigned id);  // Scores jobs until there are none left anywhere.
+    bool take_job(unsigned id, unsigned &index);  // Takes a job of the worker's own, or steals one. False if none are left.
+    void score(Interpreter &bf, unsigned id);  // Scores one program of the batch.
+
+    // Threads and mutexes can't be copied.
+    EvaluationPool(const EvaluationPool &other);
+    EvaluationPool &operator=(const EvaluationPool &other);
+
+public:
+    // Starts num_threads - 1 threads (at least one worker is always made, for the calling thread).
+    EvaluationPool(unsigned num_threads, Interpreter::Backend backend);
+    ~EvaluationPool();
+
+    /* Scores every program in the population whose ID is in jobs, and returns once all of them are done.
+       The scores are written to population.scores(), and left for the caller to pass on to the population.
+       A program's snapshot is only ever used for that program, so no two threads share one.
+       The cutoff is passed on to the evaluator (-HUGE_VAL for none), and so is the cycle budget. */
+    void evaluate(Evaluator eval, double cutoff, unsigned max_cycles, Population &population, const std::vector<unsigned> &jobs);
+
+    unsigned size() const;  // The number of threads scoring programs, counting the caller.
+
+};
+
+#endif
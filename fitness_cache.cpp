@@ -0,0 +1,153 @@
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+#include "fitness_cache.h"
+
+FitnessCache::FitnessCache(unsigned capacity) : clock(0), num_hits(0), num_misses(0)
+{
+    unsigned num_sets = 1;
+
+    while(num_sets * WAYS < capacity)
+        num_sets *= 2;
+
+    this->entries.resize(num_sets * WAYS);
+    this->set_mask = num_sets - 1;
+    this->clear();
+}
+
+/* Hashes the program 8 characters at a time, mixing each chunk in with a multiply, then scrambles the result
+   so that programs differing by a single character end up in unrelated sets. */
+FitnessCache::Key FitnessCache::key_for(const char *program, size_t program_length)
+{
+    const uint64_t MULTIPLIER = 0x9E3779B97F4A7C15ULL;
+    const char *data = program;
+    size_t length = program_length;
+    uint64_t hash = length * MULTIPLIER;
+    uint64_t chunk;
+
+    while(length >= sizeof(chunk))
+    {
+        memcpy(&chunk, data, sizeof(chunk));
+        hash = (hash ^ chunk) * MULTIPLIER;
+        hash ^= hash >> 29;
+
+        data += sizeof(chunk);
+        length -= sizeof(chunk);
+    }
+
+    // Whatever is left over makes up one last, shorter chunk.
+    if(length)
+    {
+        chunk = 0;
+        memcpy(&chunk, data, length);
+        hash = (hash ^ chunk) * MULTIPLIER;
+    }
+
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+
+    Key key = {hash, program_length};
+
+    return key;
+}
+
+FitnessCache::Key FitnessCache::key_for(const std::string &program)
+{
+    return FitnessCache::key_for(program.data(), program.length());
+}
+
+FitnessCache::Entry *FitnessCache::find_set(uint64_t hash)
+{
+    return &this->entries[(hash & this->set_mask) * WAYS];
+}
+
+bool FitnessCache::lookup(const Key &key, double &score)
+{
+    Entry *set = this->find_set(key.hash);
+
+    for(unsigned i = 0; i < WAYS; ++i)
+    {
+        if(set[i].last_used && set[i].hash == key.hash && set[i].length == key.length)
+        {
+            set[i].last_used = ++this->clock;
+            score = set[i].score;
+            ++this->num_hits;
+
+            return true;
+        }
+    }
+
+    ++this->num_misses;
+
+    return false;
+}
+
+// Stores a program's score, pushing out the least recently used score in its set if there's no room.
+void FitnessCache::store(const Key &key, double score)
+{
+    Entry *set = this->find_set(key.hash);
+    Entry *victim = &set[0];
+
+    for(unsigned i = 0; i < WAYS; ++i)
+    {
+        // If it is already cached, just update it.
+        if(set[i].last_used && set[i].hash == key.hash && set[i].length == key.length)
+        {
+            victim = &set[i];
+            break;
+        }
+
+        if(set[i].last_used < victim->last_used)
+            victim = &set[i];
+    }
+
+    victim->hash = key.hash;
+    victim->length = key.length;
+    victim->last_used = ++this->clock;
+    victim->score = score;
+}
+
+void FitnessCache::clear()
+{
+    for(size_t i = 0; i < this->entries.size(); ++i)
+        this->entries[i].last_used = 0;
+}
+
+void FitnessCache::save(std::vector<char> &buffer) const
+{
+    const char *data = reinterpret_cast<const char *>(&this->entries[0]);
+
+    buffer.insert(buffer.end(), reinterpret_cast<const char *>(&this->clock), reinterpret_cast<const char *>(&this->clock + 1));
+    buffer.insert(buffer.end(), data, data + this->entries.size() * sizeof(Entry));
+}
+
+bool FitnessCache::load(const char *data, size_t length)
+{
+    if(length != sizeof(this->clock) + this->entries.size() * sizeof(Entry))
+        return false;
+
+    memcpy(&this->clock, data, sizeof(this->clock));
+    memcpy(&this->entries[0], data + sizeof(this->clock), this->entries.size() * sizeof(Entry));
+
+    return true;
+}
+
+unsigned long FitnessCache::hits() const
+{
+    return this->num_hits;
+}
+
+unsigned long FitnessCache::misses() const
+{
+    return this->num_misses;
+}
+
+void FitnessCache::reset_counters()
+{
+    this->num_hits = 0;
+    this->num_misses = 0;
+}
@@ -0,0 +1,73 @@
+/*************************************************************************************************************
+ * Fitness Cache                                                                                             *
+ *                                                                                                           *
+ * Remembers the fitness score of programs that have already been run, so that programs which survive from   *
+ * one generation to the next (or that get evolved again) don't have to be run through the interpreter again.*
+ *                                                                                                           *
+ *      -Programs are looked up by a 64-bit hash of their source (and their length), not the source itself.  *
+ *       Two different programs sharing both is astronomically unlikely, so it is simply ignored.            *
+ *      -The cache holds a fixed number of scores, in sets of 4. When a set is full, the score used least    *
+ *       recently is forgotten to make room.                                                                 *
+ *      -Scores are only valid for a single goal output, so the cache must be cleared if it changes.         *
+ *************************************************************************************************************/
+
+#ifndef FITNESS_CACHE_H
+#define FITNESS_CACHE_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+class FitnessCache
+{
+private:
+    static const unsigned WAYS = 4;  // The number of scores that compete for room in each set.
+
+    struct Entry
+    {
+        uint64_t hash;
+        size_t length;
+        uint64_t last_used;  // When this entry was last looked up. 0 means the entry is empty.
+        double score;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t set_mask;  // Used to turn a hash into the index of its set.
+    uint64_t clock;  // Counts lookups, to tell how recently each entry was used.
+
+    unsigned long num_hits;
+    unsigned long num_misses;
+
+    Entry *find_set(uint64_t hash);  // Returns the first entry of the set a hash belongs in.
+
+public:
+    // What a program is cached under. Worked out once, so that a lookup followed by a store only hashes once.
+    struct Key
+    {
+        uint64_t hash;
+        size_t length;
+    };
+
+    // The capacity is rounded up to a power of two (and at least one set).
+    explicit FitnessCache(unsigned capacity);
+
+    static Key key_for(const std::string &program);  // Hashes a program's source.
+    static Key key_for(const char *program, size_t length);
+
+    // Looks up a program's score. Returns false (and leaves score alone) if it isn't cached.
+    bool lookup(const Key &key, double &score);
+    void store(const Key &key, double score);
+    void clear();
+
+    /* Appends every entry (and when each was last used) to buffer, for load() to put back later, on the same kind
+       of machine. Which scores a cache holds can change which programs get run, so this has to be exact. */
+    void save(std::vector<char> &buffer) const;
+    bool load(const char *data, size_t length);  // False (leaving the cache alone) if the data is from a cache of another size.
+
+    unsigned long hits() const;  // The number of lookups that found a score since the counters were last reset.
+    unsigned long misses() const;  // The number of lookups that didn't.
+    void reset_counters();
+
+};
+
+#endif
@@ -1,182 +1,861 @@
 #include <string>
 #include <iostream>
 #include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <mutex>
 #include "interpreter.h"
 
+// Profiling code goes inside PROFILE(), so that builds without INTERPRETER_PROFILE don't run any of it.
+#ifdef INTERPRETER_PROFILE
+#define PROFILE(code) code
+#else
+#define PROFILE(code)
+#endif
+
 const std::string Interpreter::ERROR = "Error";
+const unsigned Interpreter::MAX_CYCLES;  // Defined for the places that take it by reference, like std::min().
+
+#ifdef INTERPRETER_PROFILE
+// What every interpreter has counted since the profile was last taken.
+static Interpreter::Profile total_profile;
+static std::mutex total_profile_lock;
+#endif
 
-Interpreter::Interpreter()
+/* Works out how many trips around a loop it takes for a cell starting at value to reach zero,
+   if each trip changes it by step. Returns 0 if it never will, meaning the loop is infinite. */
+static unsigned loop_trips(unsigned char value, int step)
+{
+    unsigned odd_step = static_cast<unsigned char>(step);
+    unsigned shift = 0;
+
+    if(!odd_step)
+        return 0;
+
+    // Split the step into an odd part and a power of two. The value can only reach zero if it shares that power of two.
+    while(!(odd_step & 1))
+    {
+        odd_step >>= 1;
+        ++shift;
+    }
+
+    if(value & ((1u << shift) - 1))
+        return 0;
+
+    // Odd numbers always have an inverse modulo a power of two, found here with a few steps of Newton's method.
+    unsigned inverse = odd_step;
+
+    for(int i = 0; i < 3; ++i)
+        inverse *= 2 - odd_step * inverse;
+
+    unsigned modulus = 256 >> shift;
+    unsigned remaining = (256 - value) >> shift;
+
+    return (remaining * inverse) & (modulus - 1);
+}
+
+Interpreter::Interpreter(Backend bcknd)
+    : tape_low(0), tape_high(TAPE_SIZE - 1), use_idioms(true), backend(bcknd), native_code(NULL), native_code_size(0)
 {
     this->reset();
 }
 
-std::string Interpreter::run(const std::string &prgrm)
+Interpreter::Interpreter(const Interpreter &other)
+    : tape_low(0), tape_high(TAPE_SIZE - 1), use_idioms(other.use_idioms), backend(other.backend), native_code(NULL),
+      native_code_size(0)
 {
     this->reset();
-    this->program = prgrm;
+}
 
-    if(!this->check_syntax())
+Interpreter &Interpreter::operator=(const Interpreter &other)
+{
+    this->use_idioms = other.use_idioms;
+    this->backend = other.backend;
+    this->reset();
+
+    return *this;
+}
+
+void Interpreter::set_loop_idioms(bool enabled)
+{
+    this->use_idioms = enabled;
+}
+
+Interpreter::~Interpreter()
+{
+    this->free_native_code();
+}
+
+std::string Interpreter::run(const std::string &prgrm, const std::string &input)
+{
+    this->reset();
+    this->input = &input;
+
+    if(!this->compile(prgrm.data(), prgrm.length()))
         return Interpreter::ERROR;
 
-    while(this->instruction_pntr < this->program.length())
+    if(this->backend == NATIVE && this->compile_native())
+        return this->run_native() ? this->output : Interpreter::ERROR;
+
+    return this->interpret(NULL) ? this->output : Interpreter::ERROR;
+}
+
+/* The output is built up right in the snapshot's own string, which already holds whatever the program's
+   checkpoint had output, so nothing gets copied into or out of the snapshot. */
+bool Interpreter::run(const char *prgrm, size_t length, Snapshot &snapshot, OutputSink &sink, unsigned max_cycles)
+{
+    this->reset();
+    this->cycle_budget = std::min(max_cycles, this->MAX_CYCLES);
+
+    bool ok = this->compile(prgrm, length);
+
+    this->output.swap(snapshot.output);
+
+    if(ok)
     {
-        // If the program throws an error or is running too long, terminate it.
-        if(this->total_cycles > this->MAX_CYCLES || this->has_error)
-            return Interpreter::ERROR;
+        this->resume(prgrm, length, snapshot);
+
+        this->sink = &sink;
+        this->feed_sink(0);
 
-        // Now we decide which operation to perform based on the character.
-        switch(this->program[this->instruction_pntr])
+        /* Machine code always has the full MAX_CYCLES, and charges for straight-line code up front, so a program that
+           runs out of a smaller budget partway through it would be missing that code's output. */
+        if(!snapshot.checkpoints.empty() || this->cycle_budget < this->MAX_CYCLES || this->backend != NATIVE ||
+           !this->compile_native())
+            ok = this->stopped || this->interpret(&snapshot);
+        else
         {
-        case '>':
-            this->inc_pntr();
-            break;
-        case '<':
-            this->dec_pntr();
-            break;
-        case '+':
-            this->inc_byte();
+            /* Machine code can't be stopped partway, so the sink only sees the output once it has finished. If the
+               sink would have stopped it, any error after that point wouldn't have happened, just as when interpreted. */
+            bool finished = this->run_native();
+
+            this->feed_sink(0);
+            ok = this->stopped || finished;
+            this->out_of_cycles = this->out_of_cycles && !ok;
+        }
+
+        this->sink = NULL;
+    }
+    else
+    {
+        snapshot.checkpoints.clear();
+        snapshot.cells.clear();
+        this->output.clear();
+    }
+
+    /* Run one character at a time, a program that runs out of cycles always gets one past its budget before stopping.
+       A folded instruction that doesn't fit stops it short of that instead, by however many characters it stands for,
+       so programs that differ only in how their characters fold (such as canonical ones) would seem to differ. */
+    if(this->out_of_cycles)
+        this->total_cycles = this->cycle_budget + 1;
+
+    snapshot.program.assign(prgrm, length);
+    snapshot.cycles = this->total_cycles;
+    snapshot.max_cycles = this->cycle_budget;
+    snapshot.out_of_cycles = this->out_of_cycles;
+    this->output.swap(snapshot.output);
+
+    PROFILE(this->finish_profile(ok));
+
+    return ok;
+}
+
+// Runs the compiled program from wherever the instruction pointer is. Returns false if the program fails.
+bool Interpreter::interpret(Snapshot *snapshot)
+{
+    while(this->instruction_pntr < this->bytecode.size())
+    {
+        const Instruction &instr = this->bytecode[this->instruction_pntr];
+
+        /* If the program throws an error or is running too long, terminate it.
+           A folded instruction is checked as if each character it stands for were still executed one at a time. */
+        if(this->has_error || this->over_budget(instr.cycles))
+            return false;
+
+        /* Everything run so far came before this instruction, so any program with the same source up to here
+           would have gotten here in exactly the same state. */
+        if(snapshot && this->instruction_pntr >= this->frontier)
+        {
+            this->frontier = this->instruction_pntr + 1;
+            this->take_checkpoint(*snapshot);
+        }
+
+        PROFILE(++this->run_profile.opcodes[instr.op]);
+
+        // Now we decide which operation to perform based on the opcode.
+        switch(instr.op)
+        {
+        case OP_ADD:
+            this->add_byte(instr.arg);
             break;
-        case '-':
-            this->dec_byte();
+        case OP_MOVE:
+            if(!this->move_pntr(instr))
+                return false;
             break;
-        case '.':
+        case OP_OUT:
             this->out_byte();
+            if(this->stopped)
+                return true;
             break;
-        case '#':  // This was only used for debugging purposes, and is not an actual command.
+        case OP_OUT_INT:  // This was only used for debugging purposes, and is not an actual command.
             this->out_byte_as_int();
+            if(this->stopped)
+                return true;
             break;
-        case '[':
-            this->begin_loop();
+        case OP_IN:
+            this->in_byte();
             break;
-        case ']':
-            this->end_loop();
+        case OP_LOOP_BEGIN:
+            // If the byte currently being pointed to is zero, jump to just past the end of the loop.
+            if(!this->tape[this->tape_pntr])
+            {
+                this->instruction_pntr = instr.arg;
+                ++this->total_cycles;
+                continue;
+            }
             break;
+        case OP_LOOP_END:
+            /* If the byte currently being pointed to is nonzero, jump back to the beginning of the loop.
+               A ']' used to jump back onto its '[', which then had to be executed (and paid for) again before
+               the loop body ran. We jump straight into the body, but still charge for that extra cycle. */
+            if(this->tape[this->tape_pntr])
+            {
+                ++this->total_cycles;
+
+                if(this->over_budget(1))
+                    return false;
+
+                PROFILE(++this->run_profile.loop_trips[this->bytecode[instr.arg - 1].source]);
+                this->instruction_pntr = instr.arg;
+                ++this->total_cycles;
+                continue;
+            }
+            break;
+        case OP_CLEAR:
+        case OP_MUL:
+        case OP_SCAN:
+        {
+            const LoopIdiom &idiom = this->loop_idioms[instr.arg];
+
+            // A loop that would fail is entered like any other instead, and run one trip at a time until it does.
+            if((instr.op == OP_SCAN) ? this->run_scan_loop(idiom) : this->run_mul_loop(idiom))
+            {
+                this->instruction_pntr = idiom.end;
+                continue;
+            }
+            break;
+        }
         default:
             break;
         }
 
         ++this->instruction_pntr;
-        ++this->total_cycles;
+        this->total_cycles += instr.cycles;
     }
 
-    return this->output;
+    return true;
 }
 
-void Interpreter::inc_pntr()
+/* The original interpreter checked the cycle count before every character, allowing a character to run as long as
+   no more than MAX_CYCLES cycles had passed. So a run of characters only fits if its last one would still be allowed. */
+bool Interpreter::fits_budget(unsigned cycles) const
 {
-    ++this->tape_pntr;
+    return (this->total_cycles + cycles) <= (this->cycle_budget + 1);
+}
 
-    if(this->tape_pntr >= static_cast<int>(this->TAPE_SIZE))
-        this->has_error = true;
+bool Interpreter::over_budget(unsigned cycles)
+{
+    if(this->fits_budget(cycles))
+        return false;
+
+    this->out_of_cycles = true;
+    PROFILE(this->end_reason = END_OUT_OF_CYCLES);
+
+    return true;
 }
 
-void Interpreter::dec_pntr()
+bool Interpreter::move_pntr(const Instruction &instr)
 {
-    --this->tape_pntr;
+    // Going out of bounds before the final move would have been caught by the very next character of the run.
+    if(this->tape_pntr + instr.min_offset < 0 || this->tape_pntr + instr.max_offset >= static_cast<int>(this->TAPE_SIZE))
+    {
+        PROFILE(this->end_reason = (this->tape_pntr + instr.min_offset < 0) ? END_TAPE_UNDERFLOW : END_TAPE_OVERFLOW);
+        return false;
+    }
 
-    if(this->tape_pntr < 0)
+    this->tape_pntr += instr.arg;
+
+    // Going out of bounds on the final move is only an error if the program tries to execute anything afterwards.
+    if(this->tape_pntr < 0 || this->tape_pntr >= static_cast<int>(this->TAPE_SIZE))
+    {
         this->has_error = true;
+        PROFILE(this->end_reason = (this->tape_pntr < 0) ? END_TAPE_UNDERFLOW : END_TAPE_OVERFLOW);
+    }
+    else
+        this->touch_cells(this->tape_pntr, this->tape_pntr);
+
+    return true;
+}
+
+/* Runs a whole counting loop at once. It is charged exactly the cycles it would have taken one character at a time.
+   Anything that would have made it fail partway through (running out of cycles, leaving the tape or never reaching
+   zero) is found up front, and then nothing is run, so that the loop can be run the slow way to fail where it should. */
+bool Interpreter::run_mul_loop(const LoopIdiom &idiom)
+{
+    unsigned char counter = this->tape[this->tape_pntr];
+
+    // Like any other loop, a zero cell just skips over it.
+    if(!counter)
+    {
+        ++this->total_cycles;
+        return true;
+    }
+
+    unsigned trips = loop_trips(counter, idiom.step);
+
+    if(!trips)
+        return false;
+
+    if(this->tape_pntr + idiom.min_offset < 0 || this->tape_pntr + idiom.max_offset >= static_cast<int>(this->TAPE_SIZE))
+        return false;
+
+    if(!this->fits_budget(trips * idiom.trip_cycles))
+        return false;
+
+    PROFILE(this->run_profile.loop_trips[this->bytecode[this->instruction_pntr].source] += trips);
+
+    this->touch_cells(this->tape_pntr + idiom.min_offset, this->tape_pntr + idiom.max_offset);
+
+    for(unsigned i = idiom.first_target; i < idiom.first_target + idiom.num_targets; ++i)
+        this->tape[this->tape_pntr + this->mul_targets[i].offset] += trips * this->mul_targets[i].factor;
+
+    this->tape[this->tape_pntr] = 0;
+    this->total_cycles += trips * idiom.trip_cycles;
+
+    return true;
 }
 
-void Interpreter::inc_byte()
+// Runs a whole scanning loop at once, charging and failing it the same way as run_mul_loop().
+bool Interpreter::run_scan_loop(const LoopIdiom &idiom)
 {
-    ++this->tape[this->tape_pntr];
+    int pntr = this->tape_pntr;
+    unsigned trips = 0;
+
+    if(!this->tape[pntr])
+    {
+        ++this->total_cycles;
+        return true;
+    }
+
+    if(idiom.step == 1 && idiom.min_offset == 0 && idiom.max_offset == 0)
+    {
+        // The common [>] is just a search for the next zero byte.
+        const void *zero = memchr(this->tape + pntr + 1, 0, this->TAPE_SIZE - pntr - 1);
+
+        if(!zero)
+            return false;
+
+        trips = static_cast<const unsigned char *>(zero) - (this->tape + pntr);
+        pntr += trips;
+    }
+    else
+    {
+        do
+        {
+            if(pntr + idiom.min_offset < 0 || pntr + idiom.max_offset >= static_cast<int>(this->TAPE_SIZE))
+                return false;
+
+            pntr += idiom.step;
+
+            if(pntr < 0 || pntr >= static_cast<int>(this->TAPE_SIZE))
+                return false;
+
+            ++trips;
+        } while(this->tape[pntr]);
+    }
+
+    if(!this->fits_budget(trips * idiom.trip_cycles))
+        return false;
+
+    PROFILE(this->run_profile.loop_trips[this->bytecode[this->instruction_pntr].source] += trips);
+    this->tape_pntr = pntr;
+    this->touch_cells(pntr, pntr);
+    this->total_cycles += trips * idiom.trip_cycles;
+
+    return true;
+}
+
+// Widens the part of the tape the program may have written to, so that it includes the cells from low to high.
+void Interpreter::touch_cells(int low, int high)
+{
+    if(low < this->tape_low)
+        this->tape_low = low;
+    if(high > this->tape_high)
+        this->tape_high = high;
 }
 
-void Interpreter::dec_byte()
+void Interpreter::add_byte(int amount)
 {
-    --this->tape[this->tape_pntr];
+    this->tape[this->tape_pntr] += amount;
 }
 
 void Interpreter::out_byte()
 {
     this->output += this->tape[this->tape_pntr];
+
+    if(this->sink)
+        this->stopped = !this->sink->put(this->tape[this->tape_pntr]);
 }
 
 void Interpreter::out_byte_as_int()
 {
     std::stringstream int_val;
     int_val << static_cast<int>(this->tape[this->tape_pntr]);  // Need to cast char to int or else the ASCII value will be used.
+    size_t from = this->output.length();
     this->output += int_val.str();  // Then add the string representation of the number to the output.
+    this->feed_sink(from);
 }
 
+void Interpreter::in_byte()
+{
+    if(this->input && this->input_pntr < this->input->length())
+        this->tape[this->tape_pntr] = (*this->input)[this->input_pntr++];
+    else
+        this->tape[this->tape_pntr] = 0;
+}
 
-// If the byte currently being pointed to is zero, jump to the end of the loop. If not, continue with normal execution flow.
-void Interpreter::begin_loop()
+void Interpreter::feed_sink(size_t from)
 {
-    if(!this->tape[this->tape_pntr])
-        this->instruction_pntr = find_loop_match(1) - 1;
+    for(size_t i = from; this->sink && !this->stopped && i < this->output.length(); ++i)
+        this->stopped = !this->sink->put(this->output[i]);
 }
 
-// If the byte currently being pointed to is nonzero, jump to the beginning of the loop. If not, continue with normal execution flow.
-void Interpreter::end_loop()
+
+// Whether an instruction is a '+' or a '-'.
+static inline bool is_add(char c)
 {
-    if(this->tape[this->tape_pntr])
-        this->instruction_pntr = find_loop_match(-1);
+    return c == '+' || c == '-';
 }
 
-// Find the index of a matching loop bracket.
-int Interpreter::find_loop_match(int direction)
+/* Each run of +'s and -'s only adds its total to the cell (as a single instruction), and the cycles it costs only depend
+   on its length. So the run is written as its total (wrapped around to the fewest characters it can be) followed by
+   characters that aren't instructions, which cost one cycle each, making up the difference. Adding, subtracting or
+   reading input after the last output and the last loop can't change the output either, so those all become
+   non-instructions. Nothing else is changed, since everything else can affect when the program leaves the tape. */
+void Interpreter::canonicalize(const char *prgrm, size_t length, char *canonical)
 {
-    int num_nested_loops = 1;  // We count the current loop as a nested loop.
-    int tmp_instr_pntr = this->instruction_pntr + direction;
+    const char NOTHING = ' ';
+    size_t dead_from = length;  // Where nothing that follows could ever output anything.
 
-    /* We need to walk through the program to figure out where the end of the loop is, by counting how many nested loops there are.
-       Count either backwards or forwards depending on direction. */
-    while(num_nested_loops > 0)
+    while(dead_from && prgrm[dead_from - 1] != '.' && prgrm[dead_from - 1] != '#' && prgrm[dead_from - 1] != ']')
+        --dead_from;
+
+    memcpy(canonical, prgrm, length);
+
+    for(size_t i = dead_from; i < length; ++i)
+    {
+        if(is_add(prgrm[i]) || prgrm[i] == ',')
+            canonical[i] = NOTHING;
+    }
+
+    // A run of one is already as short as it can be, so only longer runs need rewriting.
+    for(size_t i = 1; i < dead_from; ++i)
     {
-        if(tmp_instr_pntr < 0 || tmp_instr_pntr >= static_cast<int>(this->program.length()))
+        if(!is_add(prgrm[i]) || !is_add(prgrm[i - 1]))
+            continue;
+
+        size_t start = i - 1;
+        int total = 0;
+
+        for(i = start; i < dead_from && is_add(prgrm[i]); ++i)
+            total += (prgrm[i] == '+') ? 1 : -1;
+
+        // Cells wrap around, so adding 255 is the same as subtracting 1.
+        total = ((total % 256) + 256) % 256;
+        if(total > 128)
+            total -= 256;
+
+        size_t kept = abs(total);
+        char sign = (total > 0) ? '+' : '-';
+
+        for(size_t j = start; j < i; ++j)
+            canonical[j] = (j - start < kept) ? sign : NOTHING;
+    }
+}
+
+
+/* Turns the program into bytecode in a single pass.
+   Runs of +/- and >/< are folded into single instructions, and every loop bracket is given the index to jump to,
+   so nothing has to be searched for while the program runs. An unmatched bracket on either side is a syntax error. */
+bool Interpreter::compile(const char *prgrm, size_t length)
+{
+    size_t i = 0;
+
+    PROFILE(this->run_profile.loop_trips.assign(length, 0));
+
+    while(i < length)
+    {
+        Instruction instr = {OP_NOP, 0, 1, static_cast<unsigned>(i), 0, 0};
+
+        switch(prgrm[i])
+        {
+        case '+':
+        case '-':
+        case '>':
+        case '<':
+            this->emit_run(prgrm, length, i);
+            continue;
+        case '.':
+            instr.op = OP_OUT;
+            break;
+        case '#':
+            instr.op = OP_OUT_INT;
+            break;
+        case ',':
+            instr.op = OP_IN;
+            break;
+        case '[':
+            instr.op = OP_LOOP_BEGIN;
+            this->open_loops.push_back(this->bytecode.size());
+            break;
+        case ']':
         {
-            this->has_error = true;
-            return -1;  // -1 has no meaning. Just needed to return.
+            if(this->open_loops.empty())
+                return false;
+
+            unsigned loop_begin = this->open_loops.back();
+            this->open_loops.pop_back();
+
+            instr.op = OP_LOOP_END;
+            instr.arg = loop_begin + 1;
+
+            if(!this->use_idioms || !this->emit_loop_idiom(loop_begin, this->bytecode.size() + 1))
+                this->bytecode[loop_begin].arg = this->bytecode.size() + 1;
+            break;
+        }
+        default:
+            // Anything else does nothing, so just add it to the cost of the previous character if it did nothing as well.
+            if(!this->bytecode.empty() && this->bytecode.back().op == OP_NOP)
+            {
+                ++this->bytecode.back().cycles;
+                ++i;
+                continue;
+            }
+            break;
         }
 
-        char c = this->program[tmp_instr_pntr];
+        this->bytecode.push_back(instr);
+        ++i;
+    }
+
+    return this->open_loops.empty();
+}
 
-        if(c == '[')
-            num_nested_loops += (direction > 0 ? 1 : -1);
-        else if(c == ']')
-            num_nested_loops += (direction > 0 ? -1 : 1);
+// Folds a run of +'s and -'s (or >'s and <'s) into one instruction, leaving index just past the end of the run.
+void Interpreter::emit_run(const char *prgrm, size_t length, size_t &index)
+{
+    bool is_move = (prgrm[index] == '>' || prgrm[index] == '<');
+    char inc = is_move ? '>' : '+';
+    char dec = is_move ? '<' : '-';
+    Instruction instr = {is_move ? OP_MOVE : OP_ADD, 0, 0, static_cast<unsigned>(index), 0, 0};
 
-        tmp_instr_pntr += direction;
+    while(index < length && (prgrm[index] == inc || prgrm[index] == dec))
+    {
+        instr.arg += (prgrm[index] == inc) ? 1 : -1;
+        ++instr.cycles;
+        ++index;
+
+        // Remember how far the pointer strays on the way, since it isn't allowed to leave the tape even temporarily.
+        if(index < length && (prgrm[index] == inc || prgrm[index] == dec))
+        {
+            if(instr.arg < instr.min_offset)
+                instr.min_offset = instr.arg;
+            if(instr.arg > instr.max_offset)
+                instr.max_offset = instr.arg;
+        }
     }
 
-    return tmp_instr_pntr;
+    this->bytecode.push_back(instr);
 }
 
-// Runs through the program making sure all loop brackets match up.
-bool Interpreter::check_syntax()
+/* Looks at the loop that starts at loop_begin and ends at the end of the bytecode so far (its ']' is yet to be added).
+   A loop body made only of additions and pointer movements that always returns to the same cell is a counting loop,
+   and one that is only a pointer movement is a scan. Either way the '[' is replaced with a single instruction that
+   runs the whole loop, and then carries on at end. */
+bool Interpreter::emit_loop_idiom(unsigned loop_begin, unsigned end)
 {
-    for(size_t i = 0; i < this->program.length(); ++i)
+    LoopIdiom idiom = {0, 2, 0, 0, static_cast<unsigned>(this->mul_targets.size()), 0, end};
+    const Instruction *last_move = NULL;
+    unsigned num_moves = 0;
+    int offset = 0;
+
+    for(unsigned i = loop_begin + 1; i < this->bytecode.size(); ++i)
     {
-        // The find_loop_match() method relies on the instruction_pntr variable
-        this->instruction_pntr = i;
+        const Instruction &instr = this->bytecode[i];
+        idiom.trip_cycles += instr.cycles;
+
+        switch(instr.op)
+        {
+        case OP_ADD:
+        {
+            unsigned target = idiom.first_target;
 
-        if(this->program[i] == '[')
-            this->find_loop_match(1);
-        else if(this->program[i] == ']')
-            this->find_loop_match(-1);
+            while(target < this->mul_targets.size() && this->mul_targets[target].offset != offset)
+                ++target;
 
-        if(this->has_error)
+            if(target == this->mul_targets.size())
+            {
+                MulTarget new_target = {offset, 0};
+                this->mul_targets.push_back(new_target);
+            }
+
+            this->mul_targets[target].factor = static_cast<unsigned char>(this->mul_targets[target].factor + instr.arg);
+            break;
+        }
+        case OP_MOVE:
+            if(offset + instr.min_offset < idiom.min_offset)
+                idiom.min_offset = offset + instr.min_offset;
+            if(offset + instr.max_offset > idiom.max_offset)
+                idiom.max_offset = offset + instr.max_offset;
+
+            offset += instr.arg;
+
+            if(offset < idiom.min_offset)
+                idiom.min_offset = offset;
+            if(offset > idiom.max_offset)
+                idiom.max_offset = offset;
+
+            last_move = &instr;
+            ++num_moves;
+            break;
+        case OP_NOP:
+            break;
+        default:
+            this->mul_targets.resize(idiom.first_target);
             return false;
+        }
     }
 
-    // Needs to be reset for when the program actually begins execution.
-    this->instruction_pntr = 0;
+    // Pull the loop's own cell out of the targets, and drop any cells that end up unchanged.
+    for(unsigned i = idiom.first_target; i < this->mul_targets.size(); ++i)
+    {
+        if(offset == 0 && this->mul_targets[i].offset == 0)
+            idiom.step = this->mul_targets[i].factor;
+        else if(this->mul_targets[i].factor)
+            this->mul_targets[idiom.first_target + idiom.num_targets++] = this->mul_targets[i];
+    }
+
+    this->mul_targets.resize(idiom.first_target + idiom.num_targets);
+
+    Instruction instr = {OP_MUL, static_cast<int>(this->loop_idioms.size()), 1, this->bytecode[loop_begin].source, 0, 0};
+
+    if(offset == 0)
+    {
+        if(!idiom.num_targets && !idiom.min_offset && !idiom.max_offset)
+            instr.op = OP_CLEAR;
+    }
+    else if(num_moves == 1 && !idiom.num_targets)
+    {
+        // A scan only needs to know where the pointer strays to before each of its moves lands.
+        instr.op = OP_SCAN;
+        idiom.step = offset;
+        idiom.min_offset = last_move->min_offset;
+        idiom.max_offset = last_move->max_offset;
+    }
+    else
+    {
+        this->mul_targets.resize(idiom.first_target);
+        return false;
+    }
+
+    this->bytecode[loop_begin] = instr;
+    this->loop_idioms.push_back(idiom);
 
     return true;
 }
 
+/* Finds how much of the program is the same as the one the snapshot was taken from, and restores the last
+   checkpoint inside that part. That checkpoint is only usable if this program has an instruction starting at the
+   same place, or else something (like a longer run of +'s) would have run differently. Nor can it have been taken
+   after more cycles than this run's budget allows, as when the snapshot was left by a run with more cycles, since
+   this run would never have gotten that far (nor output what it had by then).
+   Checkpoints after the one restored are thrown away, since they don't apply to this program. */
+void Interpreter::resume(const char *prgrm, size_t length, Snapshot &snapshot)
+{
+    size_t shared = 0;
+    size_t keep = 0;
+
+    while(shared < length && shared < snapshot.program.length() && prgrm[shared] == snapshot.program[shared])
+        ++shared;
+
+    while(keep < snapshot.checkpoints.size())
+    {
+        const Checkpoint &checkpoint = snapshot.checkpoints[keep];
+
+        if(checkpoint.source > shared || checkpoint.instruction >= this->bytecode.size() ||
+           this->bytecode[checkpoint.instruction].source != checkpoint.source || checkpoint.total_cycles > this->cycle_budget)
+            break;
+
+        ++keep;
+    }
+
+    snapshot.checkpoints.resize(keep);
+
+    if(!keep)
+    {
+        snapshot.cells.clear();
+        this->output.clear();
+        return;
+    }
+
+    const Checkpoint &checkpoint = snapshot.checkpoints.back();
+    snapshot.cells.resize(checkpoint.first_cell + checkpoint.num_cells);
+
+    memcpy(this->tape + checkpoint.tape_low, &snapshot.cells[checkpoint.first_cell], checkpoint.num_cells);
+    this->tape_low = checkpoint.tape_low;
+    this->tape_high = checkpoint.tape_low + checkpoint.num_cells - 1;
+    this->tape_pntr = checkpoint.tape_pntr;
+    this->total_cycles = checkpoint.total_cycles;
+    this->output.resize(checkpoint.output_length);
+    this->instruction_pntr = checkpoint.instruction;
+    this->frontier = checkpoint.instruction;
+}
+
+/* No program can output more than a character a cycle, and take_checkpoint() leaves at least CHECKPOINT_INTERVAL
+   characters between checkpoints and saves no more than MAX_SNAPSHOT_CELLS cells, so none of these can fill up. */
+void Interpreter::Snapshot::reserve(size_t max_length)
+{
+    this->program.reserve(max_length);
+    this->output.reserve(MAX_CYCLES + 1);
+    this->checkpoints.reserve(max_length / CHECKPOINT_INTERVAL);
+    this->cells.reserve(MAX_SNAPSHOT_CELLS);
+}
+
+/* Saves the current state, as long as the last checkpoint was far enough back in the source to be worth it.
+   Once the snapshot has saved as many cells as it can, later checkpoints are skipped, which only means programs that
+   resume from it have further to go. Programs rarely touch more than a few dozen cells, so it seldom happens. */
+void Interpreter::take_checkpoint(Snapshot &snapshot)
+{
+    unsigned source = this->bytecode[this->instruction_pntr].source;
+    unsigned next_source = CHECKPOINT_INTERVAL;
+    unsigned num_cells = this->tape_high - this->tape_low + 1;
+
+    if(!snapshot.checkpoints.empty())
+        next_source = snapshot.checkpoints.back().source + CHECKPOINT_INTERVAL;
+
+    if(source < next_source || snapshot.cells.size() + num_cells > MAX_SNAPSHOT_CELLS)
+        return;
+
+    Checkpoint checkpoint = {source, this->instruction_pntr, this->tape_pntr, this->total_cycles, this->output.length(),
+                             this->tape_low, static_cast<unsigned>(snapshot.cells.size()), num_cells};
+
+    snapshot.cells.insert(snapshot.cells.end(), this->tape + this->tape_low, this->tape + this->tape_high + 1);
+    snapshot.checkpoints.push_back(checkpoint);
+}
+
 void Interpreter::reset()
 {
+    /* Initialize the tape. Only the cells the last program touched can be nonzero, so only they need clearing,
+       which for most programs is only a handful of the thousand. */
+    this->tape = this->tape_cells;
+    memset(this->tape + this->tape_low, 0, this->tape_high - this->tape_low + 1);
+
     this->instruction_pntr = 0;
     this->tape_pntr = 0;
-    this->program = "";
-    this->output = "";
+    this->tape_low = 0;
+    this->tape_high = 0;
+    this->frontier = 0;
+    this->bytecode.clear();
+    this->loop_idioms.clear();
+    this->mul_targets.clear();
+    this->open_loops.clear();
+    this->output.clear();
     this->has_error = false;
+    this->sink = NULL;
+    this->stopped = false;
+    this->input = NULL;
+    this->input_pntr = 0;
     this->total_cycles = 0;
+    this->cycle_budget = this->MAX_CYCLES;
+    this->out_of_cycles = false;
+
+    // Syntax errors are the only failures found before the program runs, so they're what a run fails with otherwise.
+    PROFILE(this->end_reason = END_SYNTAX_ERROR);
+    PROFILE(memset(this->run_profile.opcodes, 0, sizeof(this->run_profile.opcodes)));
+}
+
+Interpreter::Profile::Profile() : runs(0), loop_trips()
+{
+    memset(this->opcodes, 0, sizeof(this->opcodes));
+    memset(this->ends, 0, sizeof(this->ends));
+}
+
+void Interpreter::Profile::add(const Profile &other)
+{
+    this->runs += other.runs;
+
+    for(unsigned i = 0; i < NUM_OPCODES; ++i)
+        this->opcodes[i] += other.opcodes[i];
+
+    for(unsigned i = 0; i < NUM_END_REASONS; ++i)
+        this->ends[i] += other.ends[i];
+
+    if(this->loop_trips.size() < other.loop_trips.size())
+        this->loop_trips.resize(other.loop_trips.size(), 0);
+
+    for(size_t i = 0; i < other.loop_trips.size(); ++i)
+        this->loop_trips[i] += other.loop_trips[i];
+}
+
+bool Interpreter::profiling()
+{
+#ifdef INTERPRETER_PROFILE
+    return true;
+#else
+    return false;
+#endif
+}
+
+const char *Interpreter::opcode_name(unsigned op)
+{
+    static const char *NAMES[] = {"add", "move", "out", "out_int", "in", "loop_begin", "loop_end", "nop", "clear", "mul", "scan"};
+
+    return (op < NUM_OPCODES) ? NAMES[op] : "unknown";
+}
+
+const char *Interpreter::end_reason_name(unsigned reason)
+{
+    static const char *NAMES[] = {"finished", "stopped", "tape underflow", "tape overflow", "out of cycles", "syntax error"};
+
+    return (reason < NUM_END_REASONS) ? NAMES[reason] : "unknown";
+}
+
+Interpreter::Profile Interpreter::take_profile()
+{
+    Profile profile;
+
+#ifdef INTERPRETER_PROFILE
+    std::lock_guard<std::mutex> lock(total_profile_lock);
+    std::swap(profile, total_profile);
+#endif
+
+    return profile;
+}
+
+#ifdef INTERPRETER_PROFILE
+// Called once a run is over, so the lock is only taken once per program rather than on every instruction.
+void Interpreter::finish_profile(bool ok)
+{
+    this->run_profile.runs = 1;
+    memset(this->run_profile.ends, 0, sizeof(this->run_profile.ends));
+
+    if(ok)
+        ++this->run_profile.ends[this->stopped ? END_STOPPED : END_FINISHED];
+    else
+        ++this->run_profile.ends[this->end_reason];
 
-    // Initialize the tape.
-    for(unsigned i = 0; i < this->TAPE_SIZE; ++i)
-        this->tape[i] = 0;
+    std::lock_guard<std::mutex> lock(total_profile_lock);
+    total_profile.add(this->run_profile);
 }
+#endif
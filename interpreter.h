@@ -3,7 +3,7 @@
  * Written by Kurtis Dinelle (http://kurtisdinelle.com)                                                      *
  *                                                                                                           *
  * A simple brainfuck interpreter written to be used only with the Brainfuck Evolved program.                *
- * Therefore, this interpreter does not include features a complete interpreter would have (such as input).  *
+ * Therefore, this interpreter does not include every feature a complete interpreter would have.            *
  *                                                                                                           *
  * Since brainfuck isn't fully defined, some assumptions had to be made:                                     *
  *                                                                                                           *
@@ -11,52 +11,298 @@
  *      -Each cell can hold an unsigned char (so up to a value of 255). Going over will cause wrap-around.   *
  *      -Going outside the bounds of a type's size is actually undefined behavior in C++,                    *
  *       however most implementations handle this via wrap-around. This interpreter relies on such behavior. *
+ *      -Input is a string given along with the program. Reading past the end of it reads a 0.               *
+ *                                                                                                           *
+ * Built with -DINTERPRETER_PROFILE, it also counts where the cycles of every program it scores go (see      *
+ * Profile). Without it, none of the counting is compiled in at all.                                         *
  *************************************************************************************************************/
 
 #ifndef INTERPRETER_H
 #define INTERPRETER_H
 
 #include <string>
+#include <vector>
 
 class Interpreter
 {
-private:
+public:
+    // How the compiled bytecode gets executed.
+    enum Backend
+    {
+        BYTECODE,  // Interpreted one instruction at a time.
+        NATIVE  // Translated to x86-64 machine code first, where supported and worth it.
+    };
+
+    static const unsigned LANES = 16;  // How many inputs are run side by side, sharing a single pass through the bytecode.
     // The max number of cycles the program can run before being assumed it is stuck in an infinite loop.
     static const unsigned MAX_CYCLES = 1000;
+
+    // The state of a program at the moment it first reached a given point in its source.
+    struct Checkpoint
+    {
+        unsigned source;  // The index in the source of the instruction about to be run.
+        unsigned instruction;  // The index of that instruction in the bytecode.
+        int tape_pntr;
+        unsigned total_cycles;
+        size_t output_length;  // How much of the program's output had been produced.
+
+        // The part of the tape the program had touched. Every other cell was still zero.
+        int tape_low;
+        unsigned first_cell;  // Where in the snapshot's cells that part of the tape was saved.
+        unsigned num_cells;
+    };
+
+    /* Checkpoints taken while running a program. Programs that share a prefix with it (like its children) can
+       start from the last checkpoint before they first differ, instead of running that prefix all over again. */
+    struct Snapshot
+    {
+        std::string program;  // The program the checkpoints were taken from.
+        std::string output;  // Everything it output, of which each checkpoint had produced a part.
+        std::vector<Checkpoint> checkpoints;
+        std::vector<unsigned char> cells;  // The tape saved at every checkpoint, one after another.
+
+        // How the run the checkpoints were taken from ended.
+        unsigned cycles;  // How many cycles the program had run for, counting any it skipped by resuming.
+        unsigned max_cycles;  // The most it was allowed to run for.
+        bool out_of_cycles;  // True if it failed by running past max_cycles.
+
+        Snapshot() : cycles(0), max_cycles(MAX_CYCLES), out_of_cycles(false) {}
+
+        // Makes room for running any program up to max_length long, so that running one doesn't allocate.
+        void reserve(size_t max_length);
+    };
+
+    // Is handed a program's output one character at a time, as soon as each is produced.
+    class OutputSink
+    {
+    public:
+        virtual ~OutputSink() {}
+        virtual bool put(unsigned char c) = 0;  // Returns false to stop the program there and then.
+    };
+
+private:
     static const unsigned TAPE_SIZE = 1000;  // The size of the tape. Subject to change.
+    static const unsigned CHECKPOINT_INTERVAL = 32;  // The least number of characters of source between two checkpoints.
+    static const unsigned MAX_SNAPSHOT_CELLS = 256;  // The most cells of tape a snapshot's checkpoints can save between them.
+
+    // The operations a program is compiled down to before it is executed.
+    enum Opcode
+    {
+        OP_ADD,  // A run of +'s and -'s folded into a single (wrapping) addition.
+        OP_MOVE,  // A run of >'s and <'s folded into a single pointer movement.
+        OP_OUT,  // A single '.'
+        OP_OUT_INT,  // A single '#', only used for debugging.
+        OP_IN,  // A single ','
+        OP_LOOP_BEGIN,  // A '[' with the index of the instruction just past its matching ']'.
+        OP_LOOP_END,  // A ']' with the index of the instruction just past its matching '['.
+        OP_NOP,  // A run of characters that aren't instructions. They do nothing, but still cost cycles.
+
+        /* Whole loops recognized at compile time and run in one step. Their arg is an index into loop_idioms.
+           Each takes the place of its loop's '[', and the rest of the loop is kept to run one trip at a time instead
+           when running it in one step would fail, so that it fails at exactly the same point. */
+        OP_CLEAR,  // A loop like [-] that only counts its cell down (or up) to zero.
+        OP_MUL,  // A loop like [->++<] that adds multiples of its cell to nearby cells while counting it to zero.
+        OP_SCAN,  // A loop like [>] that moves the pointer until it lands on a zero cell.
+
+        NUM_OPCODES  // Not an opcode, just how many there are.
+    };
+
+    struct Instruction
+    {
+        Opcode op;
+        int arg;  // The amount to add or move by, or the jump target for loops.
+        unsigned cycles;  // The number of characters of source this instruction stands for.
+        unsigned source;  // The index in the source of the first of those characters.
+
+        // For OP_MOVE: the lowest and highest offsets the pointer passes through before reaching its final position.
+        int min_offset;
+        int max_offset;
+    };
+
+    // What a recognized loop does on each trip around it.
+    struct LoopIdiom
+    {
+        int step;  // How much a trip changes the loop's own cell (OP_CLEAR/OP_MUL), or moves the pointer (OP_SCAN).
+        unsigned trip_cycles;  // The cycles one trip costs: the body, the ']' and the '[' it jumps back to.
+
+        // The lowest and highest offsets the pointer visits during a trip, relative to where the trip started.
+        int min_offset;
+        int max_offset;
+
+        // For OP_MUL: where in mul_targets the cells it adds to are listed.
+        unsigned first_target;
+        unsigned num_targets;
 
-    unsigned char tape[TAPE_SIZE];  // The memory tape.
+        unsigned end;  // The index of the instruction just past the loop's ']', where the program carries on.
+    };
+
+    // A cell an OP_MUL adds to, and how much it adds to it per trip.
+    struct MulTarget
+    {
+        int offset;
+        int factor;
+    };
+
+    /* Translating a program to machine code costs about as much as interpreting a few cycles per instruction.
+       Programs that can't run for at least this many cycles per instruction are interpreted instead. */
+    static const unsigned NATIVE_MIN_CYCLES_PER_INSTRUCTION = 8;
+
+    // The state machine code works on, laid out so generated code can reach each field at a fixed offset.
+    struct NativeState
+    {
+        Interpreter *interpreter;
+        long tape_pntr;
+        unsigned long total_cycles;
+        unsigned char *output_end;
+    };
+
+    unsigned char tape_cells[TAPE_SIZE];  // The memory tape.
+    unsigned char *tape;  // The tape being run on. Always tape_cells, except while running a lane.
 
     unsigned instruction_pntr;  // The index of the current instruction being executed
     int tape_pntr;  // The index of the current cell in the tape that the interpreter is pointing to.
+    int tape_low;  // The lowest cell the program has written to (or could have). Every cell outside these is zero.
+    int tape_high;  // The highest.
+    unsigned frontier;  // The highest instruction run so far, plus one.
 
-    std::string program;  // The current program being executed.
+    std::vector<Instruction> bytecode;  // The current program being executed, compiled.
+    std::vector<LoopIdiom> loop_idioms;  // The details of every recognized loop in the current program.
+    std::vector<MulTarget> mul_targets;  // The cells every OP_MUL in the current program adds to.
+    std::vector<unsigned> open_loops;  // Scratch stack of unmatched ['s used while compiling.
+    bool use_idioms;  // Whether recognized loops are compiled to a single instruction, or left as ordinary loops.
     std::string output;  // The programs complete output to be returned at the end of execution.
     bool has_error;  // True if the interpreter ever encounters an error in the program.
+    OutputSink *sink;  // Where output goes as it is produced, if anywhere besides the output string.
+    bool stopped;  // True once the sink has asked for the program to be stopped.
+    const std::string *input;  // What ',' reads from, if anything.
+    size_t input_pntr;  // The index of the next character of input to be read.
+
+    /* The state of every lane while a program is run on several inputs at once. Each lane has its own tape (lane n's
+       starts at n * TAPE_SIZE in lane_tapes), pointer, cycle count and place in its input. Between runs every lane's
+       tape is all zeros. While they run, tape_low and tape_high cover the cells any lane has written to. */
+    std::vector<unsigned char> lane_tapes;
+    int lane_pntrs[LANES];
+    unsigned lane_cycles[LANES];
+    size_t lane_input_pntrs[LANES];
+    // The loops the running lanes are inside: which lanes reached each one, and the instruction just past its end.
+    std::vector<std::pair<unsigned, unsigned> > lane_loops;
     unsigned total_cycles;  // The number of cycles the program has been running for.
+    unsigned cycle_budget;  // The most cycles the current run is allowed. MAX_CYCLES, unless the run was given less.
+    bool out_of_cycles;  // True if the program has failed by running past its cycle budget.
+
+    bool compile(const char *prgrm, size_t length);  // Compiles the program into bytecode. Returns false if the loop brackets don't match up.
+    void emit_run(const char *prgrm, size_t length, size_t &index);  // Folds the run of +/- or >/< starting at index into one instruction.
+    bool emit_loop_idiom(unsigned loop_begin, unsigned end);  // Replaces the loop's '[' with one instruction if it is a known idiom.
+    bool fits_budget(unsigned cycles) const;  // True if executing the next 'cycles' characters would stay within the budget.
+    bool over_budget(unsigned cycles);  // True (noting it in out_of_cycles) if executing the next 'cycles' characters would go past the budget.
+    bool interpret(Snapshot *snapshot);  // Runs the bytecode, taking checkpoints if given a snapshot. Returns false on error.
+    void resume(const char *prgrm, size_t length, Snapshot &snapshot);  // Restores the last checkpoint still valid for prgrm.
+    void take_checkpoint(Snapshot &snapshot);
 
-    void inc_pntr();  // Increments tape_pntr
-    void dec_pntr();  // Decrements tape_pntr
-    void inc_byte();  // Increments the value of the byte stored in the tape at tape_pntr
-    void dec_byte();  // Decrements the value of the byte stored in the tape at tape_pntr
+    bool move_pntr(const Instruction &instr);  // Moves tape_pntr. Returns false if it went out of bounds partway through.
+    bool run_mul_loop(const LoopIdiom &idiom);  // Runs an OP_CLEAR or OP_MUL. Returns false, changing nothing, if the loop would fail.
+    bool run_scan_loop(const LoopIdiom &idiom);  // Runs an OP_SCAN. Returns false, changing nothing, if the loop would fail.
+    void touch_cells(int low, int high);  // Widens tape_low and tape_high to include low and high.
+    void add_byte(int amount);  // Adds to the value of the byte stored in the tape at tape_pntr
     void out_byte();  // Adds the ascii value of the byte pointed to to the programs output
     void out_byte_as_int();  // Adds the integer value of the byte pointed to to the programs output. Only used for debugging.
+    void feed_sink(size_t from);  // Passes the output from 'from' onwards to the sink, stopping the program if it asks.
+    void in_byte();  // Reads the next character of input into the byte pointed to.
 
-    void begin_loop();  // Decides whether to loop or jump out of loop
-    void end_loop(); // Same as above, except kind of inverted.
+    void run_lanes(const std::string *inputs, std::string *outputs, unsigned count);  // Runs the compiled program on up to LANES inputs.
+    bool run_lane_idiom(unsigned lane, const Instruction &instr);  // Runs a recognized loop for one lane. Returns false on error.
+
+    Backend backend;  // The backend programs get executed with.
+    unsigned char *native_code;  // Executable memory that programs are translated into. Allocated on first use.
+    size_t native_code_size;  // The size of native_code in bytes.
+    unsigned char native_output[MAX_CYCLES + 1];  // Machine code writes output here. No program can run long enough to fill it.
+
+    bool compile_native();  // Translates the bytecode to machine code. Returns false if it can't be, or isn't worth it.
+    bool run_native();  // Runs the translated program, leaving its output in output. Returns false if it fails.
+    static int run_native_idiom(NativeState *state, unsigned index);  // Lets machine code run a recognized loop through the interpreter.
+    static bool is_straight_line(Opcode op);  // True for instructions that never jump.
+    void free_native_code();
 
-    int find_loop_match(int direction);  // Finds the matching loop bracket and returns its index.
-    bool check_syntax();  // Checks to make sure all ['s have matching ]'s.
     void reset();  // Resets all variables.
 
 public:
-    Interpreter();
+    explicit Interpreter(Backend bcknd = BYTECODE);
+    Interpreter(const Interpreter &other);  // Copies compile their own machine code rather than sharing it.
+    Interpreter &operator=(const Interpreter &other);
+    ~Interpreter();
+
+    // Loop idioms are on by default. Turning them off only makes programs slower, so it's for checking they change nothing.
+    void set_loop_idioms(bool enabled);
+
+    // Compiles the program and then runs through the bytecode, interpreting it, then returns any output.
+    std::string run(const std::string &prgrm, const std::string &input = "");
+
+    /* Same as above, except the program starts from the snapshot's latest checkpoint that it can, and then the
+       snapshot is updated with checkpoints for this program. With the NATIVE backend, a program given every cycle and
+       with no checkpoint to start from is run as machine code instead. That takes no checkpoints, and its output only
+       goes to the sink once it has finished.
+       Takes the program as characters rather than a string, so that it can be run straight out of the population.
+       Rather than returning the output, every character of it (including what the skipped part of the program
+       output) is passed to the sink, which can stop the program early. Stopping it isn't an error.
+       The program can be given fewer cycles than MAX_CYCLES. If it runs out, running it again with more
+       carries on from the snapshot's last checkpoint, so only the cycles since then are run over again.
+       Returns false if the program fails. Its output is left in snapshot.output, and how it ended in the rest of it. */
+    bool run(const char *prgrm, size_t length, Snapshot &snapshot, OutputSink &sink, unsigned max_cycles = MAX_CYCLES);
 
-    // Loops through the entire program, character-by-character, and interprets it, then returns any output.
-    std::string run(const std::string &prgrm);
+    /* Runs the program once for every input, giving the same outputs as running it on each in turn. The inputs are run
+       LANES at a time in lockstep, so the program is only compiled once and each instruction is only decoded once
+       for them all. A lane whose path through a loop differs from the others' waits (masked off) until they catch up.
+       outputs[n] is the output for inputs[n], or ERROR. Always interpreted, even with the NATIVE backend. */
+    void run(const char *prgrm, size_t length, const std::vector<std::string> &inputs, std::vector<std::string> &outputs);
+
+    /* Writes the program's canonical form into canonical, which needs room for length characters. It has the same
+       length as the program, and always gives exactly the same output, errors and cycle count (whatever the input),
+       so the two always score the same. Programs that only differ in ways that can't make a difference end up with the
+       same canonical form, and so only need running once between them. */
+    static void canonicalize(const char *prgrm, size_t length, char *canonical);
 
     static const std::string ERROR;  // The output returned for erroneous programs.
 
+    // How a run ended.
+    enum EndReason
+    {
+        END_FINISHED,  // It ran to the end of the program.
+        END_STOPPED,  // Its sink stopped it.
+        END_TAPE_UNDERFLOW,  // It moved off the left end of the tape.
+        END_TAPE_OVERFLOW,  // It moved off the right end.
+        END_OUT_OF_CYCLES,  // It ran past its cycle budget, or into a loop that could never end.
+        END_SYNTAX_ERROR,  // Its brackets don't match.
+
+        NUM_END_REASONS
+    };
+
+    /* What INTERPRETER_PROFILE builds count for the programs run with a snapshot (which is every program scored
+       against a goal output), added up across every interpreter. Only instructions that were actually interpreted
+       count, so nothing a program skipped by resuming from a snapshot does, and nothing run by test cases does. */
+    struct Profile
+    {
+        unsigned long runs;
+        unsigned long opcodes[NUM_OPCODES];  // How many times each opcode was executed.
+        unsigned long ends[NUM_END_REASONS];  // How many runs ended each way.
+        std::vector<unsigned long> loop_trips;  // How many trips were made around loops, by where their '[' is in the source.
+
+        Profile();
+        void add(const Profile &other);
+    };
+
+    static bool profiling();  // True if this build counts anything at all.
+    static const char *opcode_name(unsigned op);
+    static const char *end_reason_name(unsigned reason);
+    static Profile take_profile();  // Everything counted since the last call, after which counting starts over.
+
+private:
+#ifdef INTERPRETER_PROFILE
+    Profile run_profile;  // The current run's counts, added to the total once it ends.
+    EndReason end_reason;  // Why the current run failed, once it has.
+
+    void finish_profile(bool ok);  // Adds the current run's counts to the total.
+#endif
+
 };
 
 #endif
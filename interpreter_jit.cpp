@@ -0,0 +1,391 @@
+/* The native backend. Bytecode is translated into x86-64 machine code that keeps the exact same rules as the
+   interpreter: it counts cycles, keeps the pointer on the tape, and fails in all the same places.
+   Recognized loops are still handed back to the interpreter, since they already run in a single step.
+
+   While it runs, the generated code keeps the NativeState in rbx, the start of the tape in r12, the tape pointer
+   in r13, the cycle count in r14, and the address the next byte of output goes to in r15. */
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstring>
+#include "interpreter.h"
+
+#if defined(__x86_64__) && defined(__unix__)
+
+#include <sys/mman.h>
+
+// The most bytes of machine code a single bytecode instruction can turn into, and the size of everything else.
+static const size_t MAX_CODE_PER_INSTRUCTION = 96;
+static const size_t MAX_CODE_OVERHEAD = 128;
+
+// Writes machine code into a buffer, remembering the jumps that have to be pointed somewhere once everything is written.
+struct CodeBuffer
+{
+    unsigned char *code;
+    size_t size;
+    std::vector<size_t> instr_offsets;  // Where the code for each bytecode instruction begins.
+    std::vector<std::pair<size_t, unsigned> > jumps;  // Where each jump's offset was written, and the instruction it goes to.
+
+    void bytes(const char *data, size_t length)
+    {
+        memcpy(this->code + this->size, data, length);
+        this->size += length;
+    }
+
+    void byte(unsigned char value)
+    {
+        this->code[this->size++] = value;
+    }
+
+    void dword(unsigned value)
+    {
+        memcpy(this->code + this->size, &value, sizeof(value));
+        this->size += sizeof(value);
+    }
+
+    void qword(unsigned long value)
+    {
+        memcpy(this->code + this->size, &value, sizeof(value));
+        this->size += sizeof(value);
+    }
+
+    // Writes the offset of a jump, to be filled in by link().
+    void jump_to(unsigned instruction)
+    {
+        this->jumps.push_back(std::make_pair(this->size, instruction));
+        this->dword(0);
+    }
+
+    void link()
+    {
+        for(size_t i = 0; i < this->jumps.size(); ++i)
+        {
+            size_t from = this->jumps[i].first;
+            int offset = static_cast<int>(this->instr_offsets[this->jumps[i].second]) - static_cast<int>(from + 4);
+            memcpy(this->code + from, &offset, sizeof(offset));
+        }
+    }
+};
+
+// Opcodes that are used with registers fixed by the layout above.
+static const char CMP_R13[] = "\x49\x81\xFD";  // cmp r13, imm32
+static const char ADD_R13[] = "\x49\x81\xC5";  // add r13, imm32
+static const char CMP_R14[] = "\x49\x81\xFE";  // cmp r14, imm32
+static const char ADD_R14[] = "\x49\x81\xC6";  // add r14, imm32
+static const char CMP_CELL_ZERO[] = "\x43\x80\x3C\x2C\x00";  // cmp byte [r12 + r13], 0
+static const char JA[] = "\x0F\x87";
+static const char JAE[] = "\x0F\x83";
+static const char JE[] = "\x0F\x84";
+static const char JNE[] = "\x0F\x85";
+static const char JL[] = "\x0F\x8C";
+static const char JGE[] = "\x0F\x8D";
+
+
+// Fails the program if running 'cycles' more cycles would go past the limit, then charges for them.
+static void emit_charge_cycles(CodeBuffer &buf, unsigned cycles, unsigned max_cycles, unsigned error_label)
+{
+    if(cycles > max_cycles + 1)
+    {
+        buf.byte(0xE9);
+        buf.jump_to(error_label);
+        return;
+    }
+
+    buf.bytes(CMP_R14, 3);
+    buf.dword(max_cycles + 1 - cycles);
+    buf.bytes(JA, 2);
+    buf.jump_to(error_label);
+
+    buf.bytes(ADD_R14, 3);
+    buf.dword(cycles);
+}
+
+// Loads (or stores) the pointer and cycle count from (or to) the NativeState, for when the interpreter needs them.
+static void emit_sync_state(CodeBuffer &buf, bool store, unsigned char pntr_offset, unsigned char cycles_offset)
+{
+    buf.bytes(store ? "\x4C\x89\x6B" : "\x4C\x8B\x6B", 3);  // mov [rbx + d8], r13 / mov r13, [rbx + d8]
+    buf.byte(pntr_offset);
+    buf.bytes(store ? "\x4C\x89\x73" : "\x4C\x8B\x73", 3);  // mov [rbx + d8], r14 / mov r14, [rbx + d8]
+    buf.byte(cycles_offset);
+}
+
+
+/* Translates the bytecode into machine code.
+   Programs without loops run each instruction at most once, and programs too long for the cycle limit to let them
+   repeat much can't run long enough either, so translating them could never pay for itself. */
+bool Interpreter::compile_native()
+{
+    bool has_loop = false;
+
+    if(this->bytecode.size() * NATIVE_MIN_CYCLES_PER_INSTRUCTION > this->MAX_CYCLES)
+        return false;
+
+    for(size_t i = 0; i < this->bytecode.size(); ++i)
+    {
+        // Neither the debugging '#' nor input are worth supporting in machine code.
+        if(this->bytecode[i].op == OP_OUT_INT || this->bytecode[i].op == OP_IN)
+            return false;
+
+        if(this->bytecode[i].op == OP_LOOP_BEGIN)
+            has_loop = true;
+    }
+
+    if(!has_loop)
+        return false;
+
+    size_t needed = MAX_CODE_OVERHEAD + this->bytecode.size() * MAX_CODE_PER_INSTRUCTION;
+
+    if(needed > this->native_code_size)
+    {
+        this->free_native_code();
+
+        void *memory = mmap(NULL, needed, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        // If the system won't give us executable memory, there's no point trying again for every program.
+        if(memory == MAP_FAILED)
+        {
+            this->backend = BYTECODE;
+            return false;
+        }
+
+        this->native_code = static_cast<unsigned char *>(memory);
+        this->native_code_size = needed;
+    }
+
+    const unsigned num_instrs = this->bytecode.size();
+    const unsigned success_label = num_instrs;  // The "instruction" just past the end of the program.
+    const unsigned error_label = num_instrs + 1;
+    const unsigned cycles_label = num_instrs + 2;  // Where it fails by running out of cycles.
+    const unsigned char pntr_offset = offsetof(NativeState, tape_pntr);
+    const unsigned char cycles_offset = offsetof(NativeState, total_cycles);
+    const unsigned char output_offset = offsetof(NativeState, output_end);
+
+    CodeBuffer buf;
+    buf.code = this->native_code;
+    buf.size = 0;
+    buf.instr_offsets.resize(num_instrs + 3);
+
+    // Save the registers we use, and load the state into them.
+    buf.bytes("\x53\x41\x54\x41\x55\x41\x56\x41\x57", 9);  // push rbx, r12, r13, r14, r15
+    buf.bytes("\x48\x89\xFB", 3);  // mov rbx, rdi
+    buf.bytes("\x49\xBC", 2);  // mov r12, imm64
+    buf.qword(reinterpret_cast<unsigned long>(this->tape));
+    emit_sync_state(buf, false, pntr_offset, cycles_offset);
+    buf.bytes("\x4C\x8B\x7B", 3);  // mov r15, [rbx + d8]
+    buf.byte(output_offset);
+
+    for(unsigned i = 0; i < num_instrs; ++i)
+    {
+        const Instruction &instr = this->bytecode[i];
+        bool is_simple = this->is_straight_line(instr.op);
+
+        buf.instr_offsets[i] = buf.size;
+
+        /* Straight-line code either runs to its end or fails, so its cycles can all be charged up front.
+           Every jump lands at the start of such a stretch, which keeps the count exact. */
+        if(is_simple && (i == 0 || !this->is_straight_line(this->bytecode[i - 1].op)))
+        {
+            unsigned cycles = 0;
+
+            for(unsigned j = i; j < num_instrs && this->is_straight_line(this->bytecode[j].op); ++j)
+                cycles += this->bytecode[j].cycles;
+
+            emit_charge_cycles(buf, cycles, this->MAX_CYCLES, cycles_label);
+        }
+
+        switch(instr.op)
+        {
+        case OP_ADD:
+            if(static_cast<unsigned char>(instr.arg))
+            {
+                buf.bytes("\x43\x80\x04\x2C", 4);  // add byte [r12 + r13], imm8
+                buf.byte(static_cast<unsigned char>(instr.arg));
+            }
+            break;
+        case OP_MOVE:
+            // Same rules as move_pntr(): straying off the tape on the way is an error...
+            if(instr.min_offset < 0)
+            {
+                buf.bytes(CMP_R13, 3);
+                buf.dword(-instr.min_offset);
+                buf.bytes(JL, 2);
+                buf.jump_to(error_label);
+            }
+
+            if(instr.max_offset > 0)
+            {
+                buf.bytes(CMP_R13, 3);
+                buf.dword(this->TAPE_SIZE - instr.max_offset);
+                buf.bytes(JGE, 2);
+                buf.jump_to(error_label);
+            }
+
+            if(instr.arg)
+            {
+                buf.bytes(ADD_R13, 3);
+                buf.dword(instr.arg);
+            }
+
+            // ...and so is ending up off of it, unless nothing else runs afterwards.
+            if(i + 1 < num_instrs)
+            {
+                buf.bytes(CMP_R13, 3);
+                buf.dword(this->TAPE_SIZE);
+                buf.bytes(JAE, 2);
+                buf.jump_to(error_label);
+            }
+            break;
+        case OP_OUT:
+            buf.bytes("\x43\x8A\x04\x2C", 4);  // mov al, [r12 + r13]
+            buf.bytes("\x41\x88\x07", 3);  // mov [r15], al
+            buf.bytes("\x49\xFF\xC7", 3);  // inc r15
+            break;
+        case OP_LOOP_BEGIN:
+            emit_charge_cycles(buf, 1, this->MAX_CYCLES, cycles_label);
+            buf.bytes(CMP_CELL_ZERO, 5);
+            buf.bytes(JE, 2);
+            buf.jump_to(instr.arg);
+            break;
+        case OP_LOOP_END:
+            // Jumping back costs the ']' and the '[' it would have landed on.
+            emit_charge_cycles(buf, 1, this->MAX_CYCLES, cycles_label);
+            buf.bytes(CMP_CELL_ZERO, 5);
+            buf.bytes(JE, 2);
+            buf.jump_to(i + 1);
+            emit_charge_cycles(buf, 1, this->MAX_CYCLES, cycles_label);
+            buf.byte(0xE9);  // jmp rel32
+            buf.jump_to(instr.arg);
+            break;
+        case OP_CLEAR:
+        case OP_MUL:
+        case OP_SCAN:
+            // The '[' must still fit in the budget, then the interpreter takes care of the rest.
+            buf.bytes(CMP_R14, 3);
+            buf.dword(this->MAX_CYCLES);
+            buf.bytes(JA, 2);
+            buf.jump_to(cycles_label);
+
+            emit_sync_state(buf, true, pntr_offset, cycles_offset);
+            buf.bytes("\x48\x89\xDF", 3);  // mov rdi, rbx
+            buf.byte(0xBE);  // mov esi, imm32
+            buf.dword(i);
+            buf.bytes("\x48\xB8", 2);  // mov rax, imm64
+            buf.qword(reinterpret_cast<unsigned long>(&Interpreter::run_native_idiom));
+            buf.bytes("\xFF\xD0", 2);  // call rax
+            emit_sync_state(buf, false, pntr_offset, cycles_offset);
+
+            buf.bytes("\x85\xC0", 2);  // test eax, eax
+            buf.bytes(JNE, 2);
+            buf.jump_to(this->loop_idioms[instr.arg].end);
+
+            // A loop that would fail is entered like an ordinary one instead, paying for the '['.
+            buf.bytes(ADD_R14, 3);
+            buf.dword(1);
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Return 0 if the program finished, 1 if it failed, or 2 if it ran out of cycles, after saving the state back.
+    buf.instr_offsets[success_label] = buf.size;
+    buf.bytes("\x31\xC0", 2);  // xor eax, eax
+    buf.bytes("\xEB\x0C", 2);  // jmp over the next three instructions
+    buf.instr_offsets[cycles_label] = buf.size;
+    buf.byte(0xB8);  // mov eax, 2
+    buf.dword(2);
+    buf.bytes("\xEB\x05", 2);  // jmp over the next instruction
+    buf.instr_offsets[error_label] = buf.size;
+    buf.byte(0xB8);  // mov eax, 1
+    buf.dword(1);
+
+    emit_sync_state(buf, true, pntr_offset, cycles_offset);
+    buf.bytes("\x4C\x89\x7B", 3);  // mov [rbx + d8], r15
+    buf.byte(output_offset);
+    buf.bytes("\x41\x5F\x41\x5E\x41\x5D\x41\x5C\x5B", 9);  // pop r15, r14, r13, r12, rbx
+    buf.byte(0xC3);  // ret
+
+    buf.link();
+
+    return true;
+}
+
+bool Interpreter::run_native()
+{
+    typedef int (*NativeProgram)(NativeState *);
+
+    NativeState state = {this, this->tape_pntr, this->total_cycles, this->native_output};
+    NativeProgram program = reinterpret_cast<NativeProgram>(this->native_code);
+
+    int result = program(&state);
+
+    this->tape_pntr = state.tape_pntr;
+    this->total_cycles = state.total_cycles;
+    this->output.assign(reinterpret_cast<char *>(this->native_output), state.output_end - this->native_output);
+
+    // A recognized loop that runs out of cycles notes it itself, since the interpreter runs it.
+    if(result == 2)
+        this->out_of_cycles = true;
+
+    // Machine code doesn't keep track of which cells it changed, so the whole tape has to be cleared after it.
+    this->touch_cells(0, this->TAPE_SIZE - 1);
+
+    return !result;
+}
+
+void Interpreter::free_native_code()
+{
+    if(this->native_code)
+        munmap(this->native_code, this->native_code_size);
+
+    this->native_code = NULL;
+    this->native_code_size = 0;
+}
+
+#else
+
+// Anywhere else, every program is interpreted.
+bool Interpreter::compile_native()
+{
+    this->backend = BYTECODE;
+    return false;
+}
+
+bool Interpreter::run_native()
+{
+    return false;
+}
+
+void Interpreter::free_native_code()
+{
+}
+
+#endif
+
+// True for instructions that never jump, so the code for a run of them always runs from start to end (or fails).
+bool Interpreter::is_straight_line(Opcode op)
+{
+    return op == OP_ADD || op == OP_MOVE || op == OP_OUT || op == OP_NOP;
+}
+
+// Called from machine code, which has saved its state first, to run a recognized loop.
+int Interpreter::run_native_idiom(NativeState *state, unsigned index)
+{
+    Interpreter *self = state->interpreter;
+    const Instruction &instr = self->bytecode[index];
+    bool ok;
+
+    self->tape_pntr = state->tape_pntr;
+    self->total_cycles = state->total_cycles;
+
+    if(instr.op == OP_SCAN)
+        ok = self->run_scan_loop(self->loop_idioms[instr.arg]);
+    else
+        ok = self->run_mul_loop(self->loop_idioms[instr.arg]);
+
+    state->tape_pntr = self->tape_pntr;
+    state->total_cycles = self->total_cycles;
+
+    return ok;
+}
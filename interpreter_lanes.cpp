@@ -0,0 +1,319 @@
+/* Running one program on many inputs at once. Every lane runs the same bytecode in lockstep: each instruction is
+   decoded once and then applied to every lane still running, so the per-lane work is a short loop over a few small
+   arrays instead of a whole separate run of the interpreter (compiling, resetting and dispatching included).
+
+   Lanes only part ways at loops. The lanes that enter a loop (or go around it again) carry on while the rest are
+   masked off, waiting just past its end until the last of them is done with it. A lane that fails is masked off for
+   good. Since each lane is only charged for the instructions it actually runs, and is checked against the cycle
+   limit on its own, it ends up with exactly the output (or error) it would have had running on its own. */
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+#include "interpreter.h"
+
+void Interpreter::run(const char *prgrm, size_t length, const std::vector<std::string> &inputs, std::vector<std::string> &outputs)
+{
+    this->reset();
+    outputs.resize(inputs.size());
+
+    if(!this->compile(prgrm, length))
+    {
+        for(size_t i = 0; i < outputs.size(); ++i)
+            outputs[i] = Interpreter::ERROR;
+
+        return;
+    }
+
+    if(this->lane_tapes.empty())
+        this->lane_tapes.resize(LANES * TAPE_SIZE);
+
+    for(size_t first = 0; first < inputs.size(); first += LANES)
+        this->run_lanes(&inputs[first], &outputs[first], std::min<size_t>(LANES, inputs.size() - first));
+
+    this->tape = this->tape_cells;
+}
+
+// Lists the lanes whose bits are set in mask, lowest first, so loops over the running lanes don't have to test every bit.
+static unsigned list_lanes(unsigned mask, unsigned char *lanes)
+{
+    unsigned num_lanes = 0;
+
+    for(unsigned l = 0; mask; ++l, mask >>= 1)
+    {
+        if(mask & 1)
+            lanes[num_lanes++] = l;
+    }
+
+    return num_lanes;
+}
+
+void Interpreter::run_lanes(const std::string *inputs, std::string *outputs, unsigned count)
+{
+    unsigned char *cells = &this->lane_tapes[0];
+    unsigned active = (1u << count) - 1;  // The lanes running the current instruction, one bit each.
+    unsigned failed = 0;
+    unsigned off_tape = 0;  // Lanes whose pointer was left off the tape, which fail if they run anything else.
+    unsigned char running[LANES];  // The active lanes, listed.
+    unsigned num_running = list_lanes(active, running);
+    unsigned most_cycles = 0;  // No lane has run more cycles than this, so most instructions need no lane checked.
+    /* The lowest and highest cells any lane's pointer has landed on. Recognized loops widen tape_low and tape_high
+       instead, and between them the two ranges cover every cell a lane could have written to. */
+    int low = 0;
+    int high = 0;
+    unsigned ip = 0;
+
+    this->tape_low = 0;
+    this->tape_high = 0;
+    this->lane_loops.clear();
+
+    for(unsigned l = 0; l < count; ++l)
+    {
+        this->lane_pntrs[l] = 0;
+        this->lane_cycles[l] = 0;
+        this->lane_input_pntrs[l] = 0;
+        outputs[l].clear();
+    }
+
+    while(ip < this->bytecode.size())
+    {
+        const Instruction &instr = this->bytecode[ip];
+
+        // The same checks interpret() makes before every instruction.
+        unsigned failing = off_tape & active;
+
+        if(most_cycles + instr.cycles > this->MAX_CYCLES + 1)
+        {
+            most_cycles = 0;
+
+            for(unsigned l = 0; l < count; ++l)
+            {
+                if((active & (1u << l)) && this->lane_cycles[l] + instr.cycles > this->MAX_CYCLES + 1)
+                    failing |= 1u << l;
+                else if(!(failed & (1u << l)))
+                    most_cycles = std::max(most_cycles, this->lane_cycles[l]);
+            }
+        }
+
+        if(failing)
+        {
+            failed |= failing;
+            active &= ~failing;
+            num_running = list_lanes(active, running);
+        }
+
+        // If every lane running this part of the program has failed, carry on with the ones waiting for them.
+        if(!active)
+        {
+            if(this->lane_loops.empty())
+                break;
+
+            active = this->lane_loops.back().first & ~failed;
+            num_running = list_lanes(active, running);
+            ip = this->lane_loops.back().second;
+            this->lane_loops.pop_back();
+            continue;
+        }
+
+        switch(instr.op)
+        {
+        case OP_ADD:
+            for(unsigned i = 0; i < num_running; ++i)
+                cells[running[i] * TAPE_SIZE + this->lane_pntrs[running[i]]] += instr.arg;
+            break;
+        case OP_MOVE:
+            for(unsigned i = 0; i < num_running; ++i)
+            {
+                // Same rules as move_pntr().
+                unsigned l = running[i];
+                int pntr = this->lane_pntrs[l];
+
+                if(pntr + instr.min_offset < 0 || pntr + instr.max_offset >= static_cast<int>(this->TAPE_SIZE))
+                {
+                    failed |= 1u << l;
+                    continue;
+                }
+
+                pntr += instr.arg;
+                this->lane_pntrs[l] = pntr;
+
+                if(pntr < 0 || pntr >= static_cast<int>(this->TAPE_SIZE))
+                    off_tape |= 1u << l;
+                else if(pntr < low)
+                    low = pntr;
+                else if(pntr > high)
+                    high = pntr;
+            }
+
+            if(active & failed)
+            {
+                active &= ~failed;
+                num_running = list_lanes(active, running);
+            }
+            break;
+        case OP_OUT:
+            for(unsigned i = 0; i < num_running; ++i)
+                outputs[running[i]] += cells[running[i] * TAPE_SIZE + this->lane_pntrs[running[i]]];
+            break;
+        case OP_OUT_INT:
+            for(unsigned i = 0; i < num_running; ++i)
+            {
+                std::stringstream int_val;
+                int_val << static_cast<int>(cells[running[i] * TAPE_SIZE + this->lane_pntrs[running[i]]]);
+                outputs[running[i]] += int_val.str();
+            }
+            break;
+        case OP_IN:
+            for(unsigned i = 0; i < num_running; ++i)
+            {
+                unsigned l = running[i];
+                unsigned char &cell = cells[l * TAPE_SIZE + this->lane_pntrs[l]];
+                size_t &next = this->lane_input_pntrs[l];
+
+                cell = (next < inputs[l].length()) ? inputs[l][next++] : 0;
+            }
+            break;
+        case OP_LOOP_BEGIN:
+        {
+            /* Lanes on a zero cell skip the loop, paying for the jump, and wait for the rest just past its end.
+               That costs them the same single cycle the lanes entering the loop are charged below. */
+            unsigned entering = 0;
+
+            for(unsigned i = 0; i < num_running; ++i)
+            {
+                unsigned l = running[i];
+
+                if(cells[l * TAPE_SIZE + this->lane_pntrs[l]])
+                    entering |= 1u << l;
+                else
+                    ++this->lane_cycles[l];
+            }
+
+            if(!entering)
+            {
+                ++most_cycles;
+                ip = instr.arg;
+                continue;
+            }
+
+            this->lane_loops.push_back(std::make_pair(active, static_cast<unsigned>(instr.arg)));
+
+            if(entering != active)
+            {
+                active = entering;
+                num_running = list_lanes(active, running);
+            }
+            break;
+        }
+        case OP_LOOP_END:
+        {
+            // Lanes on a nonzero cell go around again, charged like interpret() charges them. The rest wait.
+            unsigned repeating = 0;
+
+            for(unsigned i = 0; i < num_running; ++i)
+            {
+                unsigned l = running[i];
+
+                if(!cells[l * TAPE_SIZE + this->lane_pntrs[l]])
+                {
+                    this->lane_cycles[l] += instr.cycles;
+                    continue;
+                }
+
+                this->lane_cycles[l] += 2;
+
+                if(this->lane_cycles[l] > this->MAX_CYCLES + 1)
+                    failed |= 1u << l;
+                else
+                    repeating |= 1u << l;
+            }
+
+            most_cycles += std::max(2u, instr.cycles);
+
+            if(repeating)
+                ip = instr.arg;
+            else
+            {
+                // Everyone is done with the loop, so the lanes that reached it carry on together.
+                repeating = this->lane_loops.back().first & ~failed;
+                this->lane_loops.pop_back();
+                ++ip;
+            }
+
+            if(repeating != active)
+            {
+                active = repeating;
+                num_running = list_lanes(active, running);
+            }
+            continue;
+        }
+        case OP_CLEAR:
+        case OP_MUL:
+        case OP_SCAN:
+            for(unsigned i = 0; i < num_running; ++i)
+            {
+                unsigned l = running[i];
+
+                if(!this->run_lane_idiom(l, instr))
+                    failed |= 1u << l;
+                else
+                    most_cycles = std::max(most_cycles, this->lane_cycles[l]);
+            }
+
+            if(active & failed)
+            {
+                active &= ~failed;
+                num_running = list_lanes(active, running);
+            }
+
+            // Only the outputs of lanes that fail matter, not where they failed, so the rest of the loop is skipped.
+            ip = this->loop_idioms[instr.arg].end;
+            continue;
+        default:
+            break;
+        }
+
+        for(unsigned i = 0; i < num_running; ++i)
+            this->lane_cycles[running[i]] += instr.cycles;
+
+        most_cycles += instr.cycles;
+        ++ip;
+    }
+
+    for(unsigned l = 0; l < count; ++l)
+    {
+        if(failed & (1u << l))
+            outputs[l] = Interpreter::ERROR;
+
+    }
+
+    // Leave the tapes clear for the next run, which only means clearing the part any lane touched.
+    this->touch_cells(low, high);
+
+    for(unsigned l = 0; l < count; ++l)
+        memset(cells + l * TAPE_SIZE + this->tape_low, 0, this->tape_high - this->tape_low + 1);
+}
+
+// Points the interpreter at the lane's state, so the loop can be run the same way as any other.
+bool Interpreter::run_lane_idiom(unsigned lane, const Instruction &instr)
+{
+    const LoopIdiom &idiom = this->loop_idioms[instr.arg];
+    bool ok;
+
+    this->tape = &this->lane_tapes[lane * TAPE_SIZE];
+    this->tape_pntr = this->lane_pntrs[lane];
+    this->total_cycles = this->lane_cycles[lane];
+
+    if(instr.op == OP_SCAN)
+        ok = this->run_scan_loop(idiom);
+    else
+        ok = this->run_mul_loop(idiom);
+
+    this->lane_pntrs[lane] = this->tape_pntr;
+    this->lane_cycles[lane] = this->total_cycles;
+    this->tape = this->tape_cells;
+
+    return ok;
+}
@@ -0,0 +1,604 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstddef>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "population.h"
+#include "lineage.h"
+
+static const char MAGIC[8] = {'B', 'F', 'E', 'V', 'O', 'L', 'I', 'N'};
+static const uint32_t VERSION = 1;  // Goes up whenever the format changes, so old logs are turned away.
+static const uint32_t NO_PARENT = 0xFFFFFFFF;  // The parents of a mating that hasn't happened.
+static const size_t BUFFER_SIZE = 1 << 20;  // How many bytes of records build up before they're handed to the thread.
+
+// The start of the file. After it come records, each a byte saying which type it is and then the record itself.
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t population_size;
+};
+
+/* A POPULATION record. After it come the length of every program (32 bits each), every score, and then the programs
+   one after another. */
+struct PopulationRecord
+{
+    uint64_t generation;  // The generation of the next mating.
+    uint32_t population_size;
+    uint32_t unused;
+    uint64_t programs_size;
+};
+
+/* A MATING record, with its edits after it. Each edit is a byte holding its type and child (type * 2 + child), the
+   position as 32 bits, and then its value: one byte for a CHANGE or INSERT, 32 bits for a loop, or nothing for a REMOVE. */
+struct MatingRecord
+{
+    uint32_t parent1;
+    uint32_t parent2;
+    uint32_t crosspoint;
+    uint32_t num_edits;
+};
+
+// An ELITE record, or a PROGRAM record (where source is the length of the program that comes after it).
+struct ReplaceRecord
+{
+    uint32_t id;
+    uint32_t source;
+};
+
+// A SCORES record is a 32-bit count, followed by that many IDs and then their scores.
+
+template <typename T>
+static void append(std::vector<char> &buffer, const T &value)
+{
+    buffer.insert(buffer.end(), reinterpret_cast<const char *>(&value), reinterpret_cast<const char *>(&value + 1));
+}
+
+// The file's contents might not be aligned for T, so it is copied out rather than pointed to.
+template <typename T>
+static T read_at(const char *data, size_t index = 0)
+{
+    T value;
+    memcpy(&value, data + index * sizeof(T), sizeof(T));
+
+    return value;
+}
+
+LineageWriter::LineageWriter() : mating_start(0), child(0), failed(false), pending(false), stopping(false)
+{
+    this->buffer.reserve(BUFFER_SIZE);
+    this->thread = std::thread(&LineageWriter::thread_main, this);
+}
+
+LineageWriter::~LineageWriter()
+{
+    {
+        std::unique_lock<std::mutex> lock(this->write_lock);
+
+        while(this->pending)
+            this->written.wait(lock);
+
+        this->writing.swap(this->buffer);
+        this->pending = !this->writing.empty();
+        this->stopping = true;
+    }
+
+    this->wake.notify_one();
+    this->thread.join();
+}
+
+bool LineageWriter::open(const std::string &filename, unsigned population_size)
+{
+    Header header;
+    std::ifstream existing(filename.c_str(), std::ios::binary);
+
+    this->filename = filename;
+
+    // A log already there is carried on with, as long as it's for the same size of population.
+    if(existing && existing.peek() != std::ifstream::traits_type::eof())
+    {
+        if(!existing.read(reinterpret_cast<char *>(&header), sizeof(header)) || memcmp(header.magic, MAGIC, sizeof(MAGIC)) ||
+           header.version != VERSION || header.population_size != population_size)
+            return false;
+
+        return static_cast<bool>(std::ofstream(filename.c_str(), std::ios::binary | std::ios::app));
+    }
+
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.population_size = population_size;
+
+    std::ofstream file(filename.c_str(), std::ios::binary | std::ios::trunc);
+
+    return file.write(reinterpret_cast<const char *>(&header), sizeof(header)) && file.flush();
+}
+
+void LineageWriter::start_record(uint8_t type)
+{
+    // Only whole records are ever handed over, and never while the thread still has the last lot.
+    if(this->buffer.size() >= BUFFER_SIZE)
+    {
+        std::unique_lock<std::mutex> lock(this->write_lock, std::try_to_lock);
+
+        if(lock.owns_lock() && !this->pending)
+        {
+            this->writing.swap(this->buffer);
+            this->buffer.clear();
+            this->pending = true;
+            lock.unlock();
+            this->wake.notify_one();
+        }
+    }
+
+    this->buffer.push_back(type);
+}
+
+void LineageWriter::population(unsigned long generation, const Population &population)
+{
+    PopulationRecord record;
+
+    record.generation = generation;
+    record.population_size = population.size();
+    record.unused = 0;
+    record.programs_size = 0;
+
+    for(unsigned id = 0; id < population.size(); ++id)
+        record.programs_size += population.length(id);
+
+    this->start_record(LineageReader::POPULATION);
+    append(this->buffer, record);
+
+    for(unsigned id = 0; id < population.size(); ++id)
+        append(this->buffer, static_cast<uint32_t>(population.length(id)));
+
+    for(unsigned id = 0; id < population.size(); ++id)
+        append(this->buffer, population.score(id));
+
+    for(unsigned id = 0; id < population.size(); ++id)
+        this->buffer.insert(this->buffer.end(), population.program(id), population.program(id) + population.length(id));
+}
+
+void LineageWriter::mating(unsigned parent1, unsigned parent2, unsigned crosspoint)
+{
+    MatingRecord record = {parent1, parent2, crosspoint, 0};
+
+    this->start_record(LineageReader::MATING);
+    this->mating_start = this->buffer.size();
+    append(this->buffer, record);
+    this->child = 0;
+}
+
+void LineageWriter::next_child()
+{
+    this->child = 1;
+}
+
+void LineageWriter::edit(LineageEdit::Type type, unsigned position, unsigned value)
+{
+    // The mating record is still the last one in the buffer, as nothing else is written while children are made.
+    char *num_edits = &this->buffer[this->mating_start + offsetof(MatingRecord, num_edits)];
+    uint32_t count = read_at<uint32_t>(num_edits) + 1;
+
+    memcpy(num_edits, &count, sizeof(count));
+
+    this->buffer.push_back(type * 2 + this->child);
+    append(this->buffer, static_cast<uint32_t>(position));
+
+    if(type == LineageEdit::CHANGE || type == LineageEdit::INSERT)
+        this->buffer.push_back(static_cast<char>(value));
+    else if(type != LineageEdit::REMOVE)
+        append(this->buffer, static_cast<uint32_t>(value));
+}
+
+void LineageWriter::elite(unsigned id, unsigned source)
+{
+    ReplaceRecord record = {id, source};
+
+    this->start_record(LineageReader::ELITE);
+    append(this->buffer, record);
+}
+
+void LineageWriter::program(unsigned id, const char *program, unsigned length)
+{
+    ReplaceRecord record = {id, length};
+
+    this->start_record(LineageReader::PROGRAM);
+    append(this->buffer, record);
+    this->buffer.insert(this->buffer.end(), program, program + length);
+}
+
+void LineageWriter::scores(const Population &population, const std::vector<unsigned> &ids)
+{
+    this->start_record(LineageReader::SCORES);
+    append(this->buffer, static_cast<uint32_t>(ids.size()));
+
+    for(size_t i = 0; i < ids.size(); ++i)
+        append(this->buffer, static_cast<uint32_t>(ids[i]));
+
+    for(size_t i = 0; i < ids.size(); ++i)
+        append(this->buffer, population.score(ids[i]));
+}
+
+void LineageWriter::thread_main()
+{
+    std::unique_lock<std::mutex> lock(this->write_lock);
+
+    while(1)
+    {
+        while(!this->pending && !this->stopping)
+            this->wake.wait(lock);
+
+        if(!this->pending)
+            return;
+
+        // Nothing else touches the records being written while they're pending, so they're written without the lock.
+        lock.unlock();
+
+        if(!this->failed)
+        {
+            std::ofstream file(this->filename.c_str(), std::ios::binary | std::ios::app);
+
+            if(!file.write(&this->writing[0], this->writing.size()) || !file.flush())
+            {
+                std::cerr << "Couldn't write lineage log '" << this->filename << "'" << std::endl;
+                this->failed = true;
+            }
+        }
+
+        lock.lock();
+        this->pending = false;
+        this->written.notify_all();
+    }
+}
+
+LineageReader::LineageReader() : data(NULL), file_size(0), next_record(NULL), record_type(POPULATION), generation_number(0)
+{
+    this->last_mating.generation = 0;
+    this->last_mating.parent1 = this->last_mating.parent2 = NO_PARENT;
+    this->last_mating.crosspoint = 0;
+}
+
+LineageReader::~LineageReader()
+{
+    this->close();
+}
+
+void LineageReader::close()
+{
+    if(this->data)
+        munmap(const_cast<char *>(this->data), this->file_size);
+
+    this->data = NULL;
+    this->file_size = 0;
+    this->next_record = NULL;
+}
+
+bool LineageReader::open(const std::string &filename)
+{
+    this->close();
+
+    int file = ::open(filename.c_str(), O_RDONLY);
+    struct stat info;
+
+    if(file < 0)
+        return false;
+
+    if(fstat(file, &info) < 0 || static_cast<size_t>(info.st_size) < sizeof(Header))
+    {
+        ::close(file);
+        return false;
+    }
+
+    void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    ::close(file);  // The mapping stays after the file is closed.
+
+    if(mapping == MAP_FAILED)
+        return false;
+
+    this->data = static_cast<const char *>(mapping);
+    this->file_size = info.st_size;
+
+    Header header = read_at<Header>(this->data);
+
+    if(memcmp(header.magic, MAGIC, sizeof(MAGIC)) || header.version != VERSION)
+    {
+        this->close();
+        return false;
+    }
+
+    // Access is in order from start to end, which lets the kernel read ahead.
+    madvise(mapping, this->file_size, MADV_SEQUENTIAL);
+
+    this->next_record = this->data + sizeof(Header);
+    this->program_list.clear();
+    this->score_list.clear();
+    this->changed_ids.clear();
+    this->generation_number = 0;
+    this->last_mating.parent1 = this->last_mating.parent2 = NO_PARENT;
+
+    return true;
+}
+
+bool LineageReader::next()
+{
+    if(!this->data || this->finished())
+        return false;
+
+    const char *end = this->data + this->file_size;
+    const char *pntr = this->next_record + 1;
+    size_t left = end - pntr;
+    uint8_t type = *this->next_record;
+
+    this->changed_ids.clear();
+
+    // A record cut short (by a run that was killed partway through writing) is the same as the end of the file.
+    if(type == POPULATION && left >= sizeof(PopulationRecord))
+    {
+        PopulationRecord record = read_at<PopulationRecord>(pntr);
+        uint64_t population_size = record.population_size;
+
+        pntr += sizeof(record);
+        left -= sizeof(record);
+
+        if(population_size * (sizeof(uint32_t) + sizeof(double)) + record.programs_size > left)
+            return false;
+
+        const char *lengths = pntr;
+        const char *scores = lengths + population_size * sizeof(uint32_t);
+        const char *program = scores + population_size * sizeof(double);
+        uint64_t programs_size = 0;
+
+        // Make sure the programs add up to the section they're in before copying any of them.
+        for(unsigned id = 0; id < population_size; ++id)
+            programs_size += read_at<uint32_t>(lengths, id);
+
+        if(programs_size != record.programs_size)
+            return false;
+
+        this->program_list.resize(population_size);
+        this->score_list.resize(population_size);
+        this->generation_number = record.generation;
+        this->last_mating.parent1 = this->last_mating.parent2 = NO_PARENT;  // So nothing before it is copied by elitism.
+
+        for(unsigned id = 0; id < population_size; ++id)
+        {
+            uint32_t length = read_at<uint32_t>(lengths, id);
+
+            this->program_list[id].assign(program, length);
+            this->score_list[id] = read_at<double>(scores, id);
+            this->changed_ids.push_back(id);
+            program += length;
+        }
+
+        pntr = program;
+    }
+    else if(type == MATING && left >= sizeof(MatingRecord))
+    {
+        pntr = this->replay_mating(pntr, end);
+
+        if(!pntr)
+            return false;
+    }
+    else if((type == ELITE || type == PROGRAM) && left >= sizeof(ReplaceRecord))
+    {
+        ReplaceRecord record = read_at<ReplaceRecord>(pntr);
+
+        pntr += sizeof(record);
+
+        if(record.id >= this->program_list.size())
+            return false;
+
+        if(type == PROGRAM)
+        {
+            if(record.source > left - sizeof(record))
+                return false;
+
+            this->program_list[record.id].assign(pntr, record.source);
+            pntr += record.source;
+        }
+        else if(record.source != NO_PARENT &&
+                (record.source == this->last_mating.parent1 || record.source == this->last_mating.parent2))
+            this->program_list[record.id] = this->parents[record.source != this->last_mating.parent1];
+        else
+            return false;
+
+        this->changed_ids.push_back(record.id);
+    }
+    else if(type == SCORES && left >= sizeof(uint32_t))
+    {
+        uint64_t count = read_at<uint32_t>(pntr);
+
+        pntr += sizeof(uint32_t);
+
+        if(count * (sizeof(uint32_t) + sizeof(double)) > left - sizeof(uint32_t))
+            return false;
+
+        const char *scores = pntr + count * sizeof(uint32_t);
+
+        for(size_t i = 0; i < count; ++i)
+        {
+            uint32_t id = read_at<uint32_t>(pntr, i);
+
+            if(id >= this->score_list.size())
+                return false;
+
+            this->score_list[id] = read_at<double>(scores, i);
+            this->changed_ids.push_back(id);
+        }
+
+        pntr = scores + count * sizeof(double);
+    }
+    else
+        return false;
+
+    this->record_type = static_cast<RecordType>(type);
+    this->next_record = pntr;
+
+    return true;
+}
+
+// Makes the children just as mate() does, then puts them through their mutations.
+const char *LineageReader::replay_mating(const char *pntr, const char *end)
+{
+    MatingRecord record = read_at<MatingRecord>(pntr);
+    Mating &mating = this->last_mating;
+
+    if(record.parent1 >= this->program_list.size() || record.parent2 >= this->program_list.size() ||
+       record.parent1 == record.parent2)
+        return NULL;
+
+    pntr += sizeof(record);
+    mating.generation = this->generation_number;
+    mating.parent1 = record.parent1;
+    mating.parent2 = record.parent2;
+    mating.crosspoint = record.crosspoint;
+    mating.edits.resize(record.num_edits);
+
+    for(uint32_t i = 0; i < record.num_edits; ++i)
+    {
+        LineageEdit &edit = mating.edits[i];
+
+        if(end - pntr < static_cast<ptrdiff_t>(1 + sizeof(uint32_t)))
+            return NULL;
+
+        edit.type = static_cast<LineageEdit::Type>(static_cast<uint8_t>(*pntr) / 2);
+        edit.child = *pntr & 1;
+        edit.position = read_at<uint32_t>(pntr + 1);
+        edit.value = 0;
+        pntr += 1 + sizeof(uint32_t);
+
+        if(edit.type == LineageEdit::CHANGE || edit.type == LineageEdit::INSERT)
+        {
+            if(pntr == end)
+                return NULL;
+
+            edit.value = static_cast<uint8_t>(*pntr++);
+        }
+        else if(edit.type != LineageEdit::REMOVE)
+        {
+            if(end - pntr < static_cast<ptrdiff_t>(sizeof(uint32_t)))
+                return NULL;
+
+            edit.value = read_at<uint32_t>(pntr);
+            pntr += sizeof(uint32_t);
+        }
+    }
+
+    this->parents[0] = this->program_list[record.parent1];
+    this->parents[1] = this->program_list[record.parent2];
+
+    const std::string &min_str = (this->parents[0].length() < this->parents[1].length()) ? this->parents[0] : this->parents[1];
+    const std::string &max_str = (&min_str == &this->parents[0]) ? this->parents[1] : this->parents[0];
+    unsigned crosspoint = record.crosspoint;
+
+    if(crosspoint > max_str.length())
+        return NULL;
+
+    std::string &child1 = this->program_list[record.parent1];
+    std::string &child2 = this->program_list[record.parent2];
+
+    child1 = min_str.substr(0, crosspoint) + max_str.substr(crosspoint);
+    child2 = max_str.substr(0, crosspoint) + ((crosspoint <= min_str.length()) ? min_str.substr(crosspoint) : "");
+
+    for(size_t i = 0; i < mating.edits.size(); ++i)
+    {
+        if(!this->replay_edit(mating.edits[i].child ? child2 : child1, mating.edits[i]))
+            return NULL;
+    }
+
+    this->changed_ids.push_back(record.parent1);
+    this->changed_ids.push_back(record.parent2);
+    ++this->generation_number;
+
+    return pntr;
+}
+
+bool LineageReader::replay_edit(std::string &child, const LineageEdit &edit)
+{
+    size_t position = edit.position;
+    size_t value = edit.value;
+
+    switch(edit.type)
+    {
+    case LineageEdit::CHANGE:
+        if(position >= child.length())
+            return false;
+
+        child[position] = static_cast<char>(value);
+        return true;
+    case LineageEdit::INSERT:
+        if(position > child.length())
+            return false;
+
+        child.insert(position, 1, static_cast<char>(value));
+        return true;
+    case LineageEdit::REMOVE:
+        if(position >= child.length())
+            return false;
+
+        child.erase(position, 1);
+        return true;
+    case LineageEdit::INSERT_LOOP:
+        if(position > value || value > child.length())
+            return false;
+
+        child.insert(value, 1, ']');
+        child.insert(position, 1, '[');
+        return true;
+    case LineageEdit::REMOVE_LOOP:
+        if(position >= value || value >= child.length())
+            return false;
+
+        child.erase(value, 1);
+        child.erase(position, 1);
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool LineageReader::finished() const
+{
+    return this->next_record == this->data + this->file_size;
+}
+
+LineageReader::RecordType LineageReader::type() const
+{
+    return this->record_type;
+}
+
+const LineageReader::Mating &LineageReader::mating() const
+{
+    return this->last_mating;
+}
+
+unsigned long LineageReader::generation() const
+{
+    return this->generation_number;
+}
+
+const std::vector<unsigned> &LineageReader::changed() const
+{
+    return this->changed_ids;
+}
+
+unsigned LineageReader::size() const
+{
+    return this->program_list.size();
+}
+
+const std::string &LineageReader::program(unsigned id) const
+{
+    return this->program_list[id];
+}
+
+double LineageReader::score(unsigned id) const
+{
+    return this->score_list[id];
+}
@@ -0,0 +1,164 @@
+/*************************************************************************************************************
+ * Lineage Log                                                                                               *
+ *                                                                                                           *
+ * Records how every program in a run came about, so that how solutions arose can be looked at afterwards    *
+ * without running evolution again.                                                                          *
+ *                                                                                                           *
+ *      -The log starts with the whole population. After that only what changed is kept: for each mating,    *
+ *       which two programs were the parents, where they were crossed over, and every mutation each child    *
+ *       had (its position and type, and the instruction it added). That's enough to rebuild every child     *
+ *       from its parents, so programs are never written out again in full, except ones put in the           *
+ *       population some other way.                                                                          *
+ *      -The scores programs get when they are scored are kept too, along with the programs elitism copies.  *
+ *      -Records are added to a buffer in memory, which a thread of its own appends to the file once it      *
+ *       fills up. Nothing waits on the file: if the last buffer is still being written, the next one just   *
+ *       keeps growing.                                                                                      *
+ *      -LineageReader maps the file into memory and replays it a record at a time, rebuilding the           *
+ *       population as it goes, which only costs copying characters around.                                  *
+ *      -Numbers are stored as they are in memory, so a log can only be read on the same kind of machine     *
+ *       that wrote it.                                                                                      *
+ *************************************************************************************************************/
+
+#ifndef LINEAGE_H
+#define LINEAGE_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include "population.h"
+
+// One mutation a child had, in the order they happened. Positions are in the child as it was just before.
+struct LineageEdit
+{
+    enum Type
+    {
+        CHANGE,  // The instruction at position was changed to value.
+        INSERT,  // Value was inserted at position.
+        REMOVE,  // The instruction at position was removed.
+        INSERT_LOOP,  // A '[' was inserted at position, and a ']' at value (before the '[' moved anything along).
+        REMOVE_LOOP,  // The brackets at position and value were removed.
+        NUM_TYPES
+    };
+
+    Type type;
+    unsigned child;  // Which of the mating's two children (0 or 1) it happened to.
+    unsigned position;
+    unsigned value;
+};
+
+class LineageWriter
+{
+private:
+    std::string filename;
+    std::vector<char> buffer;  // Records not yet handed to the thread.
+    std::vector<char> writing;  // Records the thread is writing. Only touched by the thread while it's pending.
+    size_t mating_start;  // Where the last mating record starts in the buffer, so its edits can be counted in it.
+    uint8_t child;  // Which child edits are happening to.
+    bool failed;  // Set by the thread if a write failed, after which it writes nothing more.
+
+    std::mutex write_lock;  // Guards everything below.
+    std::condition_variable wake;
+    std::condition_variable written;
+    bool pending;  // Set while the thread has records it hasn't finished writing.
+    bool stopping;  // Set when the writer is destroyed, to tell the thread to exit.
+    std::thread thread;
+
+    void thread_main();  // Appends the records it is handed to the file until the writer is destroyed.
+    void start_record(uint8_t type);  // Hands the buffer to the thread first, if it's full and the thread is free.
+
+    // Threads and mutexes can't be copied.
+    LineageWriter(const LineageWriter &other);
+    LineageWriter &operator=(const LineageWriter &other);
+
+public:
+    LineageWriter();
+    ~LineageWriter();  // Writes out every record first.
+
+    /* Starts a new log, or carries on with one already in the file (as when a run is resumed).
+       False if the file can't be written, or holds the log of a population of a different size. */
+    bool open(const std::string &filename, unsigned population_size);
+
+    // The whole population, which the records after it change. Written when a run starts (or is resumed).
+    void population(unsigned long generation, const Population &population);
+
+    /* Two parents being replaced by their children (see mate()). Edits are to the first child until next_child().
+       Each mating is the generation after the one before, so generations aren't written down except in POPULATION. */
+    void mating(unsigned parent1, unsigned parent2, unsigned crosspoint);
+    void next_child();
+    void edit(LineageEdit::Type type, unsigned position, unsigned value);
+
+    void elite(unsigned id, unsigned source);  // A program replaced by a copy of what source was before the last mating.
+    void program(unsigned id, const char *program, unsigned length);  // A program replaced by some other one.
+    void scores(const Population &population, const std::vector<unsigned> &ids);  // The scores some programs were given.
+
+};
+
+class LineageReader
+{
+public:
+    enum RecordType
+    {
+        POPULATION = 1,
+        MATING,
+        ELITE,
+        PROGRAM,
+        SCORES
+    };
+
+    // The last mating replayed.
+    struct Mating
+    {
+        unsigned long generation;
+        unsigned parent1;
+        unsigned parent2;
+        unsigned crosspoint;
+        std::vector<LineageEdit> edits;
+    };
+
+private:
+    const char *data;  // The whole file, mapped into memory. NULL until a log is opened.
+    size_t file_size;
+    const char *next_record;
+
+    RecordType record_type;  // The type of the last record replayed.
+    std::vector<std::string> program_list;
+    std::vector<double> score_list;
+    Mating last_mating;
+    unsigned long generation_number;  // The generation of the next mating.
+    std::string parents[2];  // The parents of the last mating, as they were before it, for elitism to copy.
+    std::vector<unsigned> changed_ids;  // The programs the last record replaced or scored.
+
+    void close();
+    const char *replay_mating(const char *pntr, const char *end);  // The end of the record, or NULL if it doesn't make sense.
+    bool replay_edit(std::string &child, const LineageEdit &edit);
+
+    // The mapping belongs to one reader.
+    LineageReader(const LineageReader &other);
+    LineageReader &operator=(const LineageReader &other);
+
+public:
+    LineageReader();
+    ~LineageReader();
+
+    bool open(const std::string &filename);  // False if the file can't be read, or isn't a lineage log of this version.
+
+    /* Replays the next record, after which the population is as it was just after that record was written.
+       False once there are none left, or if the rest of the file is damaged (see finished()). */
+    bool next();
+    bool finished() const;  // Whether every record in the file was replayed.
+
+    RecordType type() const;
+    const Mating &mating() const;
+    unsigned long generation() const;  // The generation the next mating would be.
+    const std::vector<unsigned> &changed() const;  // The IDs of the programs the last record replaced or scored.
+
+    unsigned size() const;  // The size of the population, which is 0 until the first POPULATION record.
+    const std::string &program(unsigned id) const;
+    double score(unsigned id) const;  // The score a program was last given (0 until it has been).
+
+};
+
+#endif
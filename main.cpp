@@ -13,40 +13,121 @@
 #include <cstdlib>
 #include <ctime>
 #include <cmath>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <cstring>
+#include <cctype>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
 #include "interpreter.h"
+#include "fitness_cache.h"
+#include "evaluation_pool.h"
+#include "evaluation_farm.h"
+#include "checkpoint.h"
+#include "telemetry.h"
+#include "lineage.h"
+#include "population.h"
+#include "random.h"
+#include "allocation_count.h"
 
 // Don't modify this group of constants.
 const unsigned CHAR_SIZE = 255;  // The max value of a 'cell' in the memory tape.
 const unsigned NUM_MUTATIONS = 3;  // The number of types of mutations: (ADD, DELETE, CHANGE).
-const char INSTRUCTIONS[] = {'+', '-', '>', '<', '[', ']', '.'};  // The list of brainfuck instructions.
-const unsigned NUM_INSTRUCTIONS = (sizeof(INSTRUCTIONS) / sizeof(INSTRUCTIONS[0]));  // Holds the number of instructions allowed.
+const char INSTRUCTIONS[] = {'+', '-', '>', '<', '[', ']', '.', ','};  // The list of brainfuck instructions.
 const unsigned NUM_CHILDREN = 2;  // Number of children two parents create upon reproduction.
 
 // Modify any constants below.
-const unsigned POP_SIZE = 10;  // The size of the population. This always remains the same between generations.
-const unsigned MIN_PROGRAM_SIZE = 10;  // The minimum size a possible program can be.
-const unsigned MAX_PROGRAM_SIZE = 500;  // The maximum size a possible program can be.
-const double MUTATION_RATE = 0.01;  // The chance of a 'gene' in a child being mutated.
 const double ERROR_SCORE = 1.0;  // The score an erroneous program receives.
 const double LENGTH_PENALTY = 0.001;  // The size of the program is multiplied by this then added to score.
 const unsigned DISPLAY_RATE = 10000;  // How often to display the best program so far.
-
-// These aren't constant because they can be changed by the user.
+const unsigned FITNESS_CACHE_SIZE = 1024;  // How many programs' scores are remembered so they don't have to be run again.
+const unsigned MIGRATION_RATE = 1000;  // How many generations islands evolve for between sending their best programs to each other.
+const unsigned ISLAND_DISPLAY_SECONDS = 5;  // How often to report progress when evolving islands.
+const unsigned BATCH_CHECK_RATE = 1000;  // How many generations a batch job evolves for between checking whether it's done.
+const unsigned MIN_CYCLE_BUDGET = 64;  // The fewest cycles the first tier gives programs, when they are run in tiers.
+const unsigned MAX_CYCLE_TIERS = 8;  // Enough tiers for budgets doubling from MIN_CYCLE_BUDGET up to the cycle limit.
+const unsigned PROFILE_LOOPS = 5;  // How many of the busiest loops each profile report shows.
+const unsigned MINIMIZE_BATCH = 256;  // How many shorter versions of a program the minimizer checks at once.
+const unsigned CHECKPOINT_RATE = 100000;  // How many generations go by between checkpoints, by default.
+const unsigned TELEMETRY_RATE = 1000;  // How many generations go by between telemetry records, by default.
+const unsigned BENCHMARK_CORPUS_SIZE = 1000;  // How many programs each corpus the interpreter is benchmarked on has.
+const unsigned BENCHMARK_PASSES = 10;  // How many times each corpus is run through.
+const unsigned long BENCHMARK_OPERATIONS = 1000000;  // How many times each genetic operator is timed at each population size.
+const double BENCHMARK_MAX_SECONDS = 60;  // How long each goal in the benchmark gets to be solved in, by default.
+const unsigned LINEAGE_MILESTONES = 20;  // How many of the latest new best programs a lineage query shows.
+const unsigned SELF_TEST_POPULATION = 1000;  // The size of the population the self-test evolves.
+const unsigned long SELF_TEST_GENERATIONS = 100000;  // How many generations it evolves for to warm up, then again while counting.
+const unsigned SELF_TEST_WORKERS = 4;  // How many worker processes the self-test's evaluation farm has.
+const unsigned SELF_TEST_KILL_AFTER = 100;  // How many programs the worker the self-test kills gets to score first.
+
+// These aren't constant because they can be changed by the user, on the command line or in a config file.
 std::string GOAL_OUTPUT = "Brainfuck";
-size_t GOAL_OUTPUT_SIZE = GOAL_OUTPUT.length();
-
+unsigned POP_SIZE = 10;  // The size of the population. This always remains the same between generations.
+unsigned MIN_PROGRAM_SIZE = 10;  // The minimum size a possible program can be.
+unsigned MAX_PROGRAM_SIZE = 500;  // The maximum size a possible program can be.
+double MUTATION_RATE = 0.01;  // The chance of a 'gene' in a child being mutated.
+// Holds the number of instructions allowed. Reading input (the last one) is only allowed when there are test cases.
+unsigned NUM_INSTRUCTIONS = (sizeof(INSTRUCTIONS) / sizeof(INSTRUCTIONS[0])) - 1;
+// Test cases (read from TEST_FILE) that programs are scored on instead of GOAL_OUTPUT, if there are any.
+std::vector<std::string> TEST_INPUTS;
+std::vector<std::string> TEST_OUTPUTS;  // The output each test case's input should give.
+std::string TEST_FILE;
+bool BRACKET_AWARE = false;  // Whether crossover and mutation keep every program's brackets matched.
+bool CANONICAL_KEYS = false;  // Whether programs are cached by their canonical form, rather than their source as it is.
+bool CYCLE_TIERS = false;  // Whether programs are run with a few cycles first, and only given more if they look worth it.
+bool GENERATIONAL = false;  // Whether every program but the best is replaced each generation, rather than just two parents.
+EvaluationFarm *evaluation_farm = NULL;  // The worker processes programs are scored in instead of the pool's threads, if any.
+
+/* How many programs have been run in all (rather than found in the cache), how many of those failed, and how many
+   of them ran out of cycles, along with the cycles they had used when they stopped (see Interpreter::Snapshot).
+   Running out of cycles and the cycles used are only known for goal outputs, not test cases. */
+std::atomic<unsigned long> programs_run(0);
+std::atomic<unsigned long> programs_failed(0);
+std::atomic<unsigned long> programs_timed_out(0);
+std::atomic<unsigned long> cycles_run(0);
+/* For each tier of cycle budgets, since the last report: how many programs were run with its budget, how many were
+   dropped when they ran out of it, and the most cycles those could have gone on to run if they hadn't been. */
+std::atomic<unsigned long> tier_programs[MAX_CYCLE_TIERS];
+std::atomic<unsigned long> tier_dropped[MAX_CYCLE_TIERS];
+std::atomic<unsigned long> tier_cycles_saved[MAX_CYCLE_TIERS];
+double FITNESS_CUTOFF = -HUGE_VAL;  // Programs that can't score at least this are stopped as soon as that's certain.
+bool CUTOFF_AT_WORST = false;  // Stops programs that can't beat the worst program in the population, as well.
+
+
+
+/* The random numbers used by whichever thread is evolving a population. Every thread that does (like each island)
+   points this at a stream of its own, split off from the one seeded in main(). */
+thread_local Random *random_stream = NULL;
+
+/* The cycles the best program needed when it was last run, which evaluate_in_tiers() bases its first budget on.
+   Kept per thread, like score_population()'s buffers, as islands each score on their own thread. */
+thread_local unsigned elite_cycles = 0;
+
+// Where the thread evolving a population records how each of its programs came about, if anywhere.
+thread_local LineageWriter *lineage_log = NULL;
+
+/* The goal output programs are scored against on each thread. Batch jobs point their own thread at their own goal
+   (and score on that thread alone). Every other thread keeps to GOAL_OUTPUT. */
+thread_local const std::string *goal_output = &GOAL_OUTPUT;
 
 
 /* These two functions used to generate either a random double or unsigned int.
    Why didn't I just overload one function? Slipped my mind at the time. */
 double get_random(double low, double high)
 {
-    return low + static_cast<double>(rand()) / static_cast<double>(static_cast<double>(RAND_MAX) / (high - low));
+    return low + random_stream->uniform() * (high - low);
 }
 
 unsigned get_random_int(unsigned low, unsigned high)
 {
-    return (rand() % (high - low + 1)) + low;
+    return random_stream->below(static_cast<uint64_t>(high) - low + 1) + low;
 }
 
 
@@ -56,77 +137,268 @@ char get_random_instruction()
 }
 
 
-void add_instruction(std::string &program, unsigned index)
+char get_random_plain_instruction()  // Any instruction but a bracket.
+{
+    char instr;
+
+    do
+        instr = get_random_instruction();
+    while(instr == '[' || instr == ']');
+
+    return instr;
+}
+
+
+/* Finds the bracket matching the one at index, or returns the program's length if it has none.
+   Looks forwards from a '[' and backwards from a ']'. */
+unsigned find_match(const char *program, unsigned length, unsigned index)
+{
+    int direction = (program[index] == '[') ? 1 : -1;
+    int depth = 0;
+
+    for(int i = index; i >= 0 && i < static_cast<int>(length); i += direction)
+    {
+        if(program[i] == '[')
+            depth += direction;
+        else if(program[i] == ']')
+            depth -= direction;
+
+        if(!depth)
+            return i;
+    }
+
+    return length;
+}
+
+
+// Replaces every bracket without a match with some other instruction.
+void balance_brackets(char *program, unsigned length)
+{
+    for(unsigned i = 0; i < length; ++i)
+    {
+        if((program[i] == '[' || program[i] == ']') && find_match(program, length, i) == length)
+            program[i] = get_random_plain_instruction();
+    }
+}
+
+
+/* Programs are edited in place in their slot in the population, which always has room for MAX_PROGRAM_SIZE instructions.
+   With BRACKET_AWARE, a bracket is only ever added along with a matching one, somewhere later in the same loop body. */
+void add_instruction(char *program, unsigned &length, unsigned index)
 {
-    std::string instr(1, get_random_instruction());  // Need to convert char to string for use by insert.
+    char instr = get_random_instruction();
+
+    if(BRACKET_AWARE && (instr == '[' || instr == ']'))
+    {
+        if((length + 2) > MAX_PROGRAM_SIZE)
+            return;
+
+        // The loop body index is in ends at the first unmatched ']' after it, or at the end of the program.
+        unsigned body_end = index;
+        int depth = 0;
+
+        while(body_end < length && depth >= 0)
+        {
+            if(program[body_end] == '[')
+                ++depth;
+            else if(program[body_end] == ']')
+                --depth;
+
+            if(depth >= 0)
+                ++body_end;
+        }
+
+        // The ']' can go anywhere at the same depth, so the new loop wraps whole instructions and loops.
+        unsigned close = index;
+        unsigned choices = 0;
+        depth = 0;
+
+        for(unsigned i = index; i <= body_end; ++i)
+        {
+            if(!depth && get_random_int(0, choices++) == 0)
+                close = i;
+
+            if(i < body_end)
+                depth += (program[i] == '[') - (program[i] == ']');
+        }
+
+        memmove(program + close + 2, program + close, length - close);
+        program[close + 1] = ']';
+        memmove(program + index + 1, program + index, close - index);
+        program[index] = '[';
+        length += 2;
+
+        if(lineage_log)
+            lineage_log->edit(LineageEdit::INSERT_LOOP, index, close);
+        return;
+    }
+
+    if((length + 1) <= MAX_PROGRAM_SIZE)
+    {
+        memmove(program + index + 1, program + index, length - index);
+        program[index] = instr;
+        ++length;
 
-    if((program.length() + 1) <= MAX_PROGRAM_SIZE)
-        program.insert(index, instr);
+        if(lineage_log)
+            lineage_log->edit(LineageEdit::INSERT, index, instr);
+    }
 }
 
 
-void remove_instruction(std::string &program, unsigned index)
+// With BRACKET_AWARE, removing a bracket removes the one it matches too, leaving the loop's body in place.
+void remove_instruction(char *program, unsigned &length, unsigned index)
 {
+    if(BRACKET_AWARE && (program[index] == '[' || program[index] == ']'))
+    {
+        unsigned match = find_match(program, length, index);
+
+        if(match == length || length < MIN_PROGRAM_SIZE + 3)
+            return;
+
+        unsigned first = std::min(index, match);
+        unsigned second = std::max(index, match);
+
+        memmove(program + first, program + first + 1, second - first - 1);
+        memmove(program + second - 1, program + second + 1, length - second - 1);
+        length -= 2;
+
+        if(lineage_log)
+            lineage_log->edit(LineageEdit::REMOVE_LOOP, first, second);
+        return;
+    }
+
     // Subtract 2 instead of 1 to account for the off-by-one difference between a string length and the last element index.
-    if((program.length() - 2) >= MIN_PROGRAM_SIZE)
-        program.erase(index, 1);
+    if((length - 2) >= MIN_PROGRAM_SIZE)
+    {
+        memmove(program + index, program + index + 1, length - index - 1);
+        --length;
+
+        if(lineage_log)
+            lineage_log->edit(LineageEdit::REMOVE, index, 0);
+    }
 }
 
 
-void mutate_instruction(std::string &program, unsigned index)
+// With BRACKET_AWARE, brackets are left alone, and only ever changed into other instructions that aren't brackets.
+void mutate_instruction(char *program, unsigned index)
 {
-    program[index] = get_random_instruction();
+    if(!BRACKET_AWARE)
+        program[index] = get_random_instruction();
+    else if(program[index] != '[' && program[index] != ']')
+        program[index] = get_random_plain_instruction();
+    else
+        return;
+
+    if(lineage_log)
+        lineage_log->edit(LineageEdit::CHANGE, index, program[index]);
 }
 
 
-// Creates a random program by first randomly determining its size and then adding that many instructions randomly.
-std::string create_random_program()
+/* Creates a random program by first randomly determining its size and then adding that many instructions randomly.
+   Returns its length. */
+unsigned create_random_program(char *program)
 {
-    std::string program;
     unsigned program_size = get_random_int(MIN_PROGRAM_SIZE, MAX_PROGRAM_SIZE);
 
-    for(unsigned i = 1; i <= program_size; ++i)
-        program += get_random_instruction();
+    for(unsigned i = 0; i < program_size; ++i)
+        program[i] = get_random_instruction();
+
+    if(BRACKET_AWARE)
+        balance_brackets(program, program_size);
 
-    return program;
+    return program_size;
 }
 
 
 // Creates the first generation's population by randomly creating programs.
-void initialize_population(std::string programs[])
+void initialize_population(Population &population)
 {
-    for(unsigned i = 0; i < POP_SIZE; ++i)
-        programs[i] = create_random_program();
+    for(unsigned i = 0; i < population.size(); ++i)
+        population.finish_program(i, create_random_program(population.new_program(i)));
 }
 
 
-// The Fitness Function. Determines how 'fit' a program is using a few different criteria.
-double calculate_fitness(const std::string &program, Interpreter &bf)
+/* With CANONICAL_KEYS, programs are cached by their canonical form (see Interpreter::canonicalize()), which scores
+   the same, so that programs which only differ in ways that can't matter share a single run. The program itself is
+   still what gets run, since that is what its snapshot was taken from, and the interpreter already folds runs of
+   '+' and '-' together when it compiles it. The canonical form is kept in a buffer per thread, and is only valid
+   until the next call on the same thread. */
+const char *canonical_program(const char *program, unsigned length)
 {
-    // The score of the worst program possible (Besides erroneous program, and not taking into account program length).
-    double max_score = GOAL_OUTPUT_SIZE * CHAR_SIZE;
-    double score = 0;
-    double final_score;
+    static thread_local std::vector<char> canonical;
 
-    std::string output = bf.run(program);
+    if(canonical.size() < length)
+        canonical.resize(length);
 
-    // Impose a very large penalty for error programs, but still allow them a chance at reproduction for genetic variation.
-    if(output == Interpreter::ERROR)
-        return ERROR_SCORE;
+    Interpreter::canonicalize(program, length, canonical.data());
+
+    return canonical.data();
+}
+
+
+/* Scores a program's output against the goal output as the program produces it, one character at a time.
+   The more each character of output is similar to its corresponding character in the goal output, the lower the cost.
+   Every character of output past the end of the goal, or of the goal past the end of the output, costs the most
+   a character can. Since nothing output later can lower the cost, the program is stopped as soon as it could
+   no longer score the cutoff even if the rest of its output matched the goal perfectly. */
+class OutputScorer : public Interpreter::OutputSink
+{
+private:
+    const std::string &goal;
+    size_t position;  // How many characters have been output so far.
+    double cost;
+    double budget;  // The most the cost can be before the program is stopped.
+
+public:
+    OutputScorer(const std::string &goal, double budget) : goal(goal), position(0), cost(0), budget(budget) {}
+
+    bool put(unsigned char c)
+    {
+        if(this->position < this->goal.length())
+            this->cost += abs(static_cast<int>(static_cast<char>(c)) - static_cast<int>(this->goal[this->position]));
+        else
+            this->cost += CHAR_SIZE;
 
-    /* We need to know whether the goal output or the program's output is larger
-       because that's how many iterations of the next loop need to be done. */
-    std::string min_str = (output.length() < GOAL_OUTPUT.length()) ? output : GOAL_OUTPUT;
-    std::string max_str = (output.length() >= GOAL_OUTPUT.length()) ? output : GOAL_OUTPUT;
+        ++this->position;
 
-    // The more each character of output is similar to its corresponding character in the goal output, the higher the score.
-    for(size_t i = 0; i < max_str.length(); ++i)
+        return this->cost <= this->budget;
+    }
+
+    // The cost of all the output, once the program is done. If it was stopped, only what it got to output counts.
+    double total()
     {
-        unsigned output_char = (i < min_str.length()) ? min_str[i] : max_str[i] + CHAR_SIZE;
-        score += abs(output_char - max_str[i]);
+        if(this->cost <= this->budget && this->position < this->goal.length())
+            return this->cost + (this->goal.length() - this->position) * CHAR_SIZE;
+
+        return this->cost;
     }
+};
+
+
+/* The Fitness Function. Determines how 'fit' a program is using a few different criteria.
+   The program is resumed from the snapshot of a similar program (such as its parent) where possible.
+   A program that can't score the cutoff is stopped early, and given the score it would have had if the rest
+   of its output had been perfect, which is still below the cutoff. That is only the best it could have scored:
+   a program that would have gone on to fail gets it instead of the error score, so it gets picked more often. */
+double calculate_fitness(const char *program, unsigned length, double cutoff, unsigned max_cycles, Interpreter &bf,
+                         Interpreter::Snapshot &snapshot)
+{
+    // The score of the worst program possible (Besides erroneous program, and not taking into account program length).
+    double max_score = goal_output->length() * CHAR_SIZE;
+    double score;
+    double final_score;
 
-    score += (program.length() * LENGTH_PENALTY);  // Impose a slight penalty for longer programs.
+    OutputScorer scorer(*goal_output, max_score - length * LENGTH_PENALTY - cutoff);
+
+    /* Impose a very large penalty for error programs, but still allow them a chance at reproduction for genetic variation.
+       A program that only ran out of a budget short of the cycle limit is scored on what it output before then instead
+       (as if it had stopped there), so that evaluate_in_tiers() can tell whether it's worth giving more cycles. */
+    if(!bf.run(program, length, snapshot, scorer, max_cycles) &&
+       !(snapshot.out_of_cycles && snapshot.max_cycles < Interpreter::MAX_CYCLES))
+        return ERROR_SCORE;
+
+    score = scorer.total();
+    score += (length * LENGTH_PENALTY);  // Impose a slight penalty for longer programs.
 
     /* The lower the score of a program, the better (think golf).
        However other calculations in the program assume a higher score is better.
@@ -137,252 +409,2587 @@ double calculate_fitness(const std::string &program, Interpreter &bf)
 }
 
 
-/* Generates a fitness score for each program in the population.
-   This is done by running the program through the brainfuck interpreter and scoring its output.
-   Also returns the best program produced. */
-std::string score_population(const std::string programs[], double scores[], int &worst_index, Interpreter &bf)
+/* The Fitness Function when there are test cases. The program is run on the input of every test case at once,
+   and each output is scored against the output that test case should give, the same way calculate_fitness() scores
+   against the goal output. A test case the program fails on is scored as if it output nothing, so that programs
+   which only get some test cases right still stand out. Only programs that fail them all get the error score.
+   Test cases all need running in full, so neither snapshots, the cutoff nor cycle budgets are used. */
+double calculate_test_fitness(const char *program, unsigned length, double, unsigned, Interpreter &bf, Interpreter::Snapshot &)
 {
-    std::string best_program;
-    double best_score = 0;
-    double worst_score = 9999;  // Arbitrarily high number.
+    static thread_local std::vector<std::string> outputs;  // Kept between calls, so the outputs' memory is reused.
+    double max_score = 0;
+    double score = 0;
+    size_t failures = 0;
+
+    bf.run(program, length, TEST_INPUTS, outputs);
 
-    for(unsigned i = 0; i < POP_SIZE; ++i)
+    for(size_t i = 0; i < outputs.size(); ++i)
     {
-        scores[i] = calculate_fitness(programs[i], bf);
+        OutputScorer scorer(TEST_OUTPUTS[i], HUGE_VAL);
+        max_score += TEST_OUTPUTS[i].length() * CHAR_SIZE;
 
-        if(scores[i] > best_score)
-        {
-            best_program = programs[i];
-            best_score = scores[i];
-        }
-        else if(scores[i] < worst_score)
+        if(outputs[i] == Interpreter::ERROR)
+            ++failures;
+        else
         {
-            worst_index = i;
-            worst_score = scores[i];
+            for(size_t j = 0; j < outputs[i].length(); ++j)
+                scorer.put(outputs[i][j]);
         }
+
+        score += scorer.total();
     }
 
-    return best_program;
+    if(failures == outputs.size())
+        return ERROR_SCORE;
+
+    score += (length * LENGTH_PENALTY);
+
+    return max_score - score;
 }
 
 
-// Adds every program's fitness score together.
-double pop_score_total(const double scores[])
+// How many of the test cases the program passes.
+size_t count_passes(Interpreter &bf, const std::string &program)
 {
-    double total = 0;
+    std::vector<std::string> outputs;
+    size_t passes = 0;
 
-    for(unsigned i = 0; i < POP_SIZE; ++i)
-        total += scores[i];
+    bf.run(program.data(), program.length(), TEST_INPUTS, outputs);
 
-    return total;
+    for(size_t i = 0; i < outputs.size(); ++i)
+        passes += (outputs[i] == TEST_OUTPUTS[i]);
+
+    return passes;
 }
 
 
-/* Selects a parent to mate using fitness proportionate selection.
-   Basically, the more fit a program is, the more likely it is to be selected. */
-std::string select_parent(const std::string programs[], const double scores[], const std::string &other_parent = "")
+// True if the program does what programs are being evolved to do: output the goal output, or pass every test case.
+bool solves_goal(Interpreter &bf, const std::string &program)
 {
-    double program_chances[POP_SIZE];  // Holds each program's chance of being selected (a # between 0 and 1).
-    double score_total = pop_score_total(scores);
-    double rand_val = get_random(0.0, 1.0);
+    if(TEST_INPUTS.empty())
+        return bf.run(program) == *goal_output;
 
-    for(unsigned i = 0; i < POP_SIZE; ++i)
-    {
-        // Cast i to int so when we go to subtract 1, if i is 0 it doesn't overflow (as an unsigned int can't be negative).
-        double prev_chance = ((static_cast<int>(i) - 1) < 0) ? 0 : program_chances[i - 1];
+    return count_passes(bf, program) == TEST_INPUTS.size();
+}
 
-        /* We add the previous program's chance to this program's chance because that is its range of being selected.
-           The higher the fitness score, the bigger this program's range is. */
-        program_chances[i] = (scores[i] / score_total) + (prev_chance);
 
-        // Need to subtract a small amount from rand_val due to floating-point precision errors. Without it, equality check could fail.
-        if(program_chances[i] >= (rand_val - 0.001) && (programs[i] != other_parent))
-            return programs[i];
-    }
+// Scores the jobs in the evaluation farm's worker processes if there are any, or else across the pool's threads.
+void evaluate_jobs(EvaluationPool &pool, double cutoff, unsigned max_cycles, Population &population, const std::vector<unsigned> &jobs)
+{
+    if(evaluation_farm)
+        evaluation_farm->evaluate(cutoff, max_cycles, population, jobs);
+    else
+        pool.evaluate(TEST_INPUTS.empty() ? calculate_fitness : calculate_test_fitness, cutoff, max_cycles, population, jobs);
+}
+
 
-    /* If the other parent was the last program in the list, we might get here.
-       In that case, just return the 1st program. */
-    return programs[0];
+// True if evaluate_in_tiers() gave the program the error score before it had used every cycle it could have.
+bool dropped_early(const Interpreter::Snapshot &snapshot)
+{
+    return snapshot.out_of_cycles && snapshot.max_cycles < Interpreter::MAX_CYCLES;
 }
 
 
-/* Mutates a program by either inserting, removing, or changing an instruction.
-   This returns a string rather than modifying a a string just due to the way it is used in the program. */
-std::string mutate(std::string child)
+/* Scores the jobs with a small cycle budget first, and only gives more cycles to the programs still worth running.
+   The programs that use up every cycle allowed are the ones stuck in loops, and most of them show it long before
+   then by outputting nothing worth having. The first tier's budget is twice the cycles the best program needed
+   the last time one was run (but at least MIN_CYCLE_BUDGET), and each tier after that doubles it, up to the limit.
+   A program that runs out is only moved up a tier if what it has output so far would already beat the worst
+   program. The rest get the error score, as if they had run out for good. Moving up resumes from the program's
+   snapshot, so little of it is run twice.
+   A program that would have finished in time can't be told apart from one that never would, so a few programs
+   get the error score that wouldn't have without tiers. dropped_early() picks them out, so they aren't cached. */
+void evaluate_in_tiers(Population &population, EvaluationPool &pool, double cutoff, const std::vector<unsigned> &jobs)
 {
-    // Loop through each command and randomly decide to mutate it based on the mutation rate.
-    for(size_t i = 0; i < child.length(); ++i)
+    static thread_local std::vector<unsigned> tier_jobs;
+    static thread_local std::vector<unsigned> promoted;
+
+    double *scores = population.scores();
+    double elite_score = population.score(population.best());
+    double promote_above = population.score(population.worst());
+    unsigned budget = std::max(MIN_CYCLE_BUDGET, 2 * elite_cycles);
+
+    tier_jobs.assign(jobs.begin(), jobs.end());
+
+    for(unsigned tier = 0; !tier_jobs.empty(); ++tier)
     {
-        if(MUTATION_RATE >= get_random(0.0, 1.0))
+        budget = std::min(budget, Interpreter::MAX_CYCLES);
+        evaluate_jobs(pool, cutoff, budget, population, tier_jobs);
+
+        unsigned long dropped = 0;
+        unsigned long cycles_saved = 0;
+
+        promoted.clear();
+
+        for(size_t i = 0; i < tier_jobs.size(); ++i)
         {
-            unsigned mutation_type = get_random_int(1, NUM_MUTATIONS);
+            unsigned id = tier_jobs[i];
+            const Interpreter::Snapshot &snapshot = population.snapshot(id);
 
-            switch(mutation_type)
+            if(dropped_early(snapshot))
+            {
+                if(scores[id] > promote_above)
+                    promoted.push_back(id);
+                else
+                {
+                    scores[id] = ERROR_SCORE;
+                    ++dropped;
+                    cycles_saved += Interpreter::MAX_CYCLES - snapshot.cycles;
+                }
+            }
+            else if(scores[id] != ERROR_SCORE && scores[id] >= elite_score)
             {
-            case 1:
-                mutate_instruction(child, i);
-                break;
-            case 2:
-                add_instruction(child, i);
-                break;
-            case 3:
-                remove_instruction(child, i);
-                break;
-            default:
-                break;
+                elite_score = scores[id];
+                elite_cycles = snapshot.cycles;
             }
         }
-    }
 
-    return child;
+        tier_programs[tier].fetch_add(tier_jobs.size(), std::memory_order_relaxed);
+        tier_dropped[tier].fetch_add(dropped, std::memory_order_relaxed);
+        tier_cycles_saved[tier].fetch_add(cycles_saved, std::memory_order_relaxed);
+
+        tier_jobs.swap(promoted);
+        budget *= 2;
+    }
 }
 
 
-// Performs crossover between two parents to produce two children.
-void mate(const std::string &parent1, const std::string &parent2, std::string children[])
+/* Generates a fitness score for each program in the population that has changed since it was last scored.
+   This is done by running the program through the brainfuck interpreter and scoring its output, unless the program
+   (or, with CANONICAL_KEYS, one with the same canonical form) has been scored before, which the elite and duplicates
+   often will have been.
+   The programs that do need running are scored all at once, spread across the pool's threads.
+   Each program resumes from (and then replaces) the snapshot of whichever program was in its place before it. */
+void score_population(Population &population, EvaluationPool &pool, FitnessCache &cache)
 {
-    // We need to find which program is longest.
-    std::string min_str = (parent1.length() < parent2.length()) ? parent1 : parent2;
-    std::string max_str = (parent1.length() >= parent2.length()) ? parent1 : parent2;
+    // Kept from one call to the next (one set per thread, as islands score on their own), so scoring doesn't allocate.
+    static thread_local std::vector<std::pair<uint64_t, unsigned> > misses;  // The hash and ID of each program not in the cache.
+    static thread_local std::vector<unsigned> jobs;
 
-    // Determine a crossover point at random.
-    unsigned crosspoint = get_random_int(1, max_str.length() - 1);
+    const std::vector<unsigned> &unscored = population.unscored();
+    double *scores = population.scores();
+
+    misses.clear();
+    jobs.clear();
+
+    for(size_t i = 0; i < unscored.size(); ++i)
+    {
+        unsigned id = unscored[i];
+        const char *program = population.program(id);
+        FitnessCache::Key key;
 
-    // Find the substring of the program after the crossover point
-    std::string max_str_contrib = max_str.substr(crosspoint);
+        if(CANONICAL_KEYS)
+            program = canonical_program(program, population.length(id));
 
-    // Then erase after that point
-    max_str.erase(crosspoint);
+        key = FitnessCache::key_for(program, population.length(id));
 
-    /* If the cross-over point is less than the length of the smaller program, then we need to combine part of it with the larger program.
-       If not, then we do nothing and just take part of the larger program and add it to it. */
-    if(crosspoint <= min_str.length())
+        if(!cache.lookup(key, scores[id]))
+            misses.push_back(std::make_pair(key.hash, id));
+    }
+
+    // Sorting puts duplicates next to each other, so only the first of each needs running.
+    std::sort(misses.begin(), misses.end());
+
+    for(size_t i = 0; i < misses.size(); ++i)
     {
-        max_str += min_str.substr(crosspoint);
-        min_str.erase(crosspoint);
+        if(!i || misses[i].first != misses[i - 1].first)
+            jobs.push_back(misses[i].second);
     }
 
-    // Add the 2nd part of the larger program to the smaller program.
-    min_str += max_str_contrib;
+    // Children that would be the worst program anyway aren't worth running to the end.
+    double cutoff = FITNESS_CUTOFF;
+    if(CUTOFF_AT_WORST && !jobs.empty())
+        cutoff = std::max(cutoff, population.score(population.worst()));
 
-    // Call the mutate function on the children which has a small chance of actually causing a mutation.
-    children[0] = mutate(min_str);
-    children[1] = mutate(max_str);
+    if(CYCLE_TIERS && TEST_INPUTS.empty())
+        evaluate_in_tiers(population, pool, cutoff, jobs);
+    else
+        evaluate_jobs(pool, cutoff, Interpreter::MAX_CYCLES, population, jobs);
+
+    unsigned long failures = 0;
+    unsigned long timeouts = 0;
+    unsigned long cycles = 0;
+    for(size_t i = 0; i < jobs.size(); ++i)
+    {
+        const Interpreter::Snapshot &snapshot = population.snapshot(jobs[i]);
+
+        failures += (scores[jobs[i]] == ERROR_SCORE);
+        timeouts += snapshot.out_of_cycles;
+        cycles += snapshot.cycles;
+    }
+
+    programs_run.fetch_add(jobs.size(), std::memory_order_relaxed);
+    programs_failed.fetch_add(failures, std::memory_order_relaxed);
+    programs_timed_out.fetch_add(timeouts, std::memory_order_relaxed);
+    cycles_run.fetch_add(cycles, std::memory_order_relaxed);
+
+    /* Store the new scores in a set order, so the cache ends up the same no matter how the threads finished.
+       Scores below the cutoff might be from programs that were stopped early, so they aren't kept, and nor are the
+       scores of programs dropped early by evaluate_in_tiers(). */
+    for(size_t i = 0; i < misses.size(); ++i)
+    {
+        unsigned id = misses[i].second;
+
+        if(i && misses[i].first == misses[i - 1].first)
+            scores[id] = scores[misses[i - 1].second];
+        else if(scores[id] >= cutoff && !dropped_early(population.snapshot(id)))
+        {
+            FitnessCache::Key key = {misses[i].first, population.length(id)};
+            cache.store(key, scores[id]);
+        }
+    }
+
+    population.update_scores(unscored);
+
+    if(lineage_log && !unscored.empty())
+        lineage_log->scores(population, unscored);
+
+    population.clear_unscored();
 }
 
 
-bool program_exists(const std::string &program, const std::string programs[])
+/* Shows on out, for each tier of cycle budgets that programs were run in since the last report, how many programs it
+   ran, and how many of those it dropped. Every cycle a dropped program had left under the limit is one it might have
+   spent looping, which is the most running it in tiers could have saved. Each line starts with a newline. */
+void report_cycle_tiers(std::ostream &out)
 {
-    for(unsigned i = 0; i < POP_SIZE; ++i)
+    for(unsigned tier = 0; tier < MAX_CYCLE_TIERS && tier_programs[tier]; ++tier)
     {
-        if(program == programs[i])
-            return true;
+        out << "\nCycle tier " << (tier + 1) << ": " << tier_dropped[tier] << " of " << tier_programs[tier]
+                  << " programs dropped (up to " << tier_cycles_saved[tier] << " cycles saved)";
+
+        tier_programs[tier] = 0;
+        tier_dropped[tier] = 0;
+        tier_cycles_saved[tier] = 0;
     }
+}
 
-    return false;
+
+/* Shows on out where the interpreted cycles went since the last report, in builds with INTERPRETER_PROFILE (see
+   Interpreter::Profile): how many times each opcode was executed, how the runs ended, and the loops that were gone
+   around the most, by where their '[' is. Each line starts with a newline. Other builds show nothing. */
+void report_profile(std::ostream &out)
+{
+    Interpreter::Profile profile = Interpreter::take_profile();
+
+    if(!profile.runs)
+        return;
+
+    out << "\nProfile of " << profile.runs << " runs";
+
+    const char *separator = "\n  Opcodes executed: ";
+    for(unsigned op = 0; op < sizeof(profile.opcodes) / sizeof(profile.opcodes[0]); ++op)
+    {
+        if(profile.opcodes[op])
+        {
+            out << separator << Interpreter::opcode_name(op) << " " << profile.opcodes[op];
+            separator = ", ";
+        }
+    }
+
+    separator = "\n  Runs ended: ";
+    for(unsigned reason = 0; reason < Interpreter::NUM_END_REASONS; ++reason)
+    {
+        if(profile.ends[reason])
+        {
+            out << separator << Interpreter::end_reason_name(reason) << " " << profile.ends[reason] << " ("
+                      << (100.0 * profile.ends[reason] / profile.runs) << "%)";
+            separator = ", ";
+        }
+    }
+
+    std::vector<std::pair<unsigned long, size_t> > loops;  // Trips, then where the loop is, so sorting puts the busiest last.
+    for(size_t i = 0; i < profile.loop_trips.size(); ++i)
+    {
+        if(profile.loop_trips[i])
+            loops.push_back(std::make_pair(profile.loop_trips[i], i));
+    }
+
+    std::sort(loops.begin(), loops.end());
+
+    separator = "\n  Busiest loops: ";
+    for(size_t i = 0; i < loops.size() && i < PROFILE_LOOPS; ++i)
+    {
+        const std::pair<unsigned long, size_t> &loop = loops[loops.size() - 1 - i];
+
+        out << separator << "'[' at " << loop.second << " (" << loop.first << " trips)";
+        separator = ", ";
+    }
+}
+
+
+/* Selects a parent to mate using fitness proportionate selection.
+   Basically, the more fit a program is, the more likely it is to be selected. Returns the parent's ID. */
+unsigned select_parent(Population &population, int other_parent = -1)
+{
+    return population.select(get_random(0.0, 1.0), other_parent);
 }
 
 
-void replace_program(const std::string &parent, const std::string &child, std::string programs[])
+/* Mutates a program by either inserting, removing, or changing an instruction.
+   The program is changed in place, and its length updated. */
+void mutate(char *child, unsigned &length)
 {
-    for(unsigned i = 0; i < POP_SIZE; ++i)
+    /* Each command has a chance of being mutated based on the mutation rate. Rather than rolling for every one,
+       skip straight to the next command that will be mutated, so most children cost only a single roll. */
+    for(unsigned i = random_stream->geometric(MUTATION_RATE, length); i < length;
+        i += 1 + random_stream->geometric(MUTATION_RATE, length))
     {
-        if(parent == programs[i])
+        unsigned mutation_type = get_random_int(1, NUM_MUTATIONS);
+
+        switch(mutation_type)
         {
-            programs[i] = child;
+        case 1:
+            mutate_instruction(child, i);
+            break;
+        case 2:
+            add_instruction(child, length, i);
+            break;
+        case 3:
+            remove_instruction(child, length, i);
+            break;
+        default:
             break;
         }
     }
 }
 
 
-int main(int argc, char *argv[])
+/* Picks the point mate() crosses two parents over at. With BRACKET_AWARE, it is only picked from the points where the
+   two parents are inside the same number of loops, so both children have matched brackets. Returns 0 if there are
+   none, which leaves the children as copies of the parents. */
+unsigned pick_crosspoint(const char *min_str, unsigned min_length, const char *max_str, unsigned max_length)
 {
-    // Check if ran from command line.
-    if(argc > 1)
+    if(!BRACKET_AWARE)
+        return get_random_int(1, max_length - 1);
+
+    unsigned choices = 0;
+    unsigned choice = 0;
+
+    // The first pass counts the points, and the second finds the one picked.
+    for(int pass = 0; pass < 2; ++pass)
     {
-        GOAL_OUTPUT = argv[1];
-        GOAL_OUTPUT_SIZE = GOAL_OUTPUT.length();
+        int min_depth = 0;
+        int max_depth = 0;
+
+        for(unsigned crosspoint = 1; crosspoint < max_length; ++crosspoint)
+        {
+            if(crosspoint <= min_length)
+                min_depth += (min_str[crosspoint - 1] == '[') - (min_str[crosspoint - 1] == ']');
+            max_depth += (max_str[crosspoint - 1] == '[') - (max_str[crosspoint - 1] == ']');
+
+            if(min_depth != max_depth)
+                continue;
+
+            if(pass && !choice--)
+                return crosspoint;
+
+            ++choices;
+        }
+
+        if(!choices)
+            return 0;
+
+        choice = get_random_int(0, choices - 1);
     }
 
-    // Initialize the brainfuck interpreter and seed random.
-    Interpreter brainfuck;
-    srand(time(0));
+    return 0;
+}
 
-    std::string programs[POP_SIZE];
-    double fitness_scores[POP_SIZE];
 
-    initialize_population(programs);
+/* Crosses two parents over into two children, written into child1 and child2 (which mustn't be either parent).
+   Returns the crossover point. */
+unsigned cross_over(const char *parent1, unsigned length1, const char *parent2, unsigned length2,
+                    char *child1, unsigned &child1_length, char *child2, unsigned &child2_length)
+{
+    // We need to find which program is longest.
+    bool first_is_shorter = (length1 < length2);
+    const char *min_str = first_is_shorter ? parent1 : parent2;
+    const char *max_str = first_is_shorter ? parent2 : parent1;
+    unsigned min_length = first_is_shorter ? length1 : length2;
+    unsigned max_length = first_is_shorter ? length2 : length1;
 
-    std::string best_program;
+    // Determine a crossover point at random.
+    unsigned crosspoint = pick_crosspoint(min_str, min_length, max_str, max_length);
 
-    bool keep_going = false;  // Just used to have the program keep searching after a match is found.
+    /* The first child is the smaller program up to the crossover point (or all of it, if it isn't that long),
+       followed by the rest of the larger program. */
+    unsigned min_contrib = (crosspoint <= min_length) ? crosspoint : min_length;
+    child1_length = min_contrib + (max_length - crosspoint);
 
-    unsigned long generations = 0;
+    memcpy(child1, min_str, min_contrib);
+    memcpy(child1 + min_contrib, max_str + crosspoint, max_length - crosspoint);
 
-    // And now we just repeat the process of selection and reproduction over and over again.
-    while(1)
+    /* The second child is the larger program up to the crossover point, followed by the rest of the smaller program
+       if the cross-over point is less than its length. */
+    child2_length = crosspoint;
+
+    memcpy(child2, max_str, crosspoint);
+
+    if(crosspoint <= min_length)
     {
-        int worst_program_index = 0;
+        memcpy(child2 + crosspoint, min_str + crosspoint, min_length - crosspoint);
+        child2_length += min_length - crosspoint;
+    }
 
-        best_program = score_population(programs, fitness_scores, worst_program_index, brainfuck);
+    return crosspoint;
+}
 
-        // Select two parents randomly using fitness proportionate selection
-        std::string parent1 = select_parent(programs, fitness_scores);
-        std::string parent2 = select_parent(programs, fitness_scores, parent1);
 
-        // Mate them to create children
-        std::string children[NUM_CHILDREN];
-        mate(parent1, parent2, children);
+/* Performs crossover between two parents to produce two children, which replace them.
+   The children are written straight into the parents' spare slots, so the parents can be read while they are. */
+void mate(Population &population, unsigned parent1, unsigned parent2)
+{
+    char *child1 = population.new_program(parent1);
+    char *child2 = population.new_program(parent2);
+    unsigned child1_length;
+    unsigned child2_length;
 
-        /* Replace the parent programs with the children. We replace the parents to lessen the chance of premature convergence.
-           This works because by replacing the parents, which are most similar to the children, genetic diversity is maintained.
-           If the parents were not replaced, the population would quickly fill with similar genetic information. */
-        replace_program(parent1, children[0], programs);
-        replace_program(parent2, children[1], programs);
+    unsigned crosspoint = cross_over(population.program(parent1), population.length(parent1), population.program(parent2),
+                                     population.length(parent2), child1, child1_length, child2, child2_length);
 
-        /* Replace the worst program with the best program if it was replaced by its child. (Elitism).
-           This is done to ensure the best program is never lost. */
-        if(!program_exists(best_program, programs))
-            programs[worst_program_index] = best_program;
+    if(lineage_log)
+        lineage_log->mating(parent1, parent2, crosspoint);
 
-        // Report on the current best program every so often.
-        if(!(generations % DISPLAY_RATE))
+    // Call the mutate function on the children which has a small chance of actually causing a mutation.
+    mutate(child1, child1_length);
+    if(lineage_log)
+        lineage_log->next_child();
+    mutate(child2, child2_length);
+
+    population.finish_program(parent1, child1_length);
+    population.finish_program(parent2, child2_length);
+}
+
+
+// Scores the population, then replaces two parents with their children.
+void evolve_generation(Population &population, EvaluationPool &pool, FitnessCache &cache)
+{
+    score_population(population, pool, cache);
+
+    unsigned best_program_id = population.best();
+    unsigned worst_program_id = population.worst();
+
+    // Select two parents randomly using fitness proportionate selection
+    unsigned parent1 = select_parent(population);
+    unsigned parent2 = select_parent(population, parent1);
+
+    // The first child starts with the shorter parent's program and the second with the longer one's (see mate()).
+    bool first_child_takes_after_parent2 = population.length(parent1) >= population.length(parent2);
+
+    /* Mate them to create children, which replace the parents. We replace the parents to lessen the chance of premature convergence.
+       This works because by replacing the parents, which are most similar to the children, genetic diversity is maintained.
+       If the parents were not replaced, the population would quickly fill with similar genetic information. */
+    mate(population, parent1, parent2);
+
+    // Make sure each child sits on the snapshot of the parent it takes after, so it can resume from it.
+    if(first_child_takes_after_parent2)
+        population.swap_snapshots(parent1, parent2);
+
+    /* Replace the worst program with the best program if it was replaced by its child. (Elitism).
+       This is done to ensure the best program is never lost. The replaced best program is still in its spare slot. */
+    if(best_program_id == parent1 || best_program_id == parent2)
+    {
+        const char *best_program = population.previous_program(best_program_id);
+        unsigned best_length = population.previous_length(best_program_id);
+
+        if(!population.contains(best_program, best_length))
         {
-            std::cout << "\n\nBest program evolved so far: " << std::endl;
-            std::cout << best_program << std::endl;
+            population.set_program(worst_program_id, best_program, best_length);
 
-            std::string output = brainfuck.run(best_program);
-            std::cout << "\nOutput: " << output << std::endl;
+            if(lineage_log)
+                lineage_log->elite(worst_program_id, best_program_id);
+        }
+    }
+}
 
-            if(output == GOAL_OUTPUT && !keep_going)
-            {
-                std::cout << "\n\a\a\aProgram evolved!" << std::endl;
-                std::cout << "Save source code as a text file? (y/n) ";
 
-                char answer;
-                std::cin >> answer;
+/* Scores the population, then replaces every program but the best with children bred from it, all in one go (see
+   --generational). Parents are all picked from the population as it was scored, so every child can be bred before
+   any is scored, and the next call scores them all as one batch. A parent that has already been replaced by a child
+   is still in its spare slot, which is where it's read from. */
+void breed_generation(Population &population, EvaluationPool &pool, FitnessCache &cache)
+{
+    // Kept from one call to the next, so breeding doesn't allocate.
+    static thread_local std::vector<unsigned> parents;  // Two for every mating.
+    static thread_local std::vector<unsigned char> replaced;  // Whether each program has been replaced by a child yet.
+    static thread_local std::vector<char> discarded;  // Where a second child goes when there's no room for it.
 
-                if(answer == 'y')
-                {
-                    std::ofstream srcfile("bfsrc.txt");
-                    srcfile << GOAL_OUTPUT << ":\n\n" << best_program;
-                    std::cout << "Source code saved as 'bfsrc.txt'\n" << std::endl;
-                }
+    score_population(population, pool, cache);
 
-                //std::cout << "It took roughly " << generations << " generations to evolve this program." << std::endl;
-                std::cout << "Keep evolving for more efficiency? (y/n) ";
-                std::cin >> answer;
+    unsigned best = population.best();
+    unsigned num_children = population.size() - 1;
+    unsigned matings = (num_children + NUM_CHILDREN - 1) / NUM_CHILDREN;
 
-                // Quit the program if the user doesn't want to continue.
-                if(answer != 'y')
-                    return 0;
+    parents.resize(NUM_CHILDREN * matings);
+    replaced.assign(population.size(), 0);
+    discarded.resize(MAX_PROGRAM_SIZE);
 
-                keep_going = true;
+    for(unsigned i = 0; i < matings; ++i)
+    {
+        parents[2 * i] = select_parent(population);
+        parents[2 * i + 1] = select_parent(population, parents[2 * i]);
+    }
+
+    // The children take every place but the best program's, in order.
+    unsigned next_child = (best == 0);
+
+    for(unsigned i = 0; i < matings; ++i)
+    {
+        unsigned parent1 = parents[2 * i];
+        unsigned parent2 = parents[2 * i + 1];
+        unsigned child1_id = next_child;
+        unsigned child2_id = next_child + 1 + (next_child + 1 == best);
+        bool has_child2 = (child2_id < population.size());
+        unsigned child1_length;
+        unsigned child2_length;
+
+        cross_over(replaced[parent1] ? population.previous_program(parent1) : population.program(parent1),
+                   replaced[parent1] ? population.previous_length(parent1) : population.length(parent1),
+                   replaced[parent2] ? population.previous_program(parent2) : population.program(parent2),
+                   replaced[parent2] ? population.previous_length(parent2) : population.length(parent2),
+                   population.new_program(child1_id), child1_length,
+                   has_child2 ? population.new_program(child2_id) : &discarded[0], child2_length);
+
+        mutate(population.new_program(child1_id), child1_length);
+        population.finish_program(child1_id, child1_length);
+        replaced[child1_id] = 1;
+
+        if(has_child2)
+        {
+            mutate(population.new_program(child2_id), child2_length);
+            population.finish_program(child2_id, child2_length);
+            replaced[child2_id] = 1;
+        }
+
+        next_child = child2_id + 1 + (child2_id + 1 == best);
+    }
+}
+
+
+/* The most a program can score, before the length penalty: what it scores if every character it outputs is right.
+   Every wrong character costs at least 1. */
+double max_score()
+{
+    if(TEST_INPUTS.empty())
+        return goal_output->length() * CHAR_SIZE;
+
+    double score = 0;
+    for(size_t i = 0; i < TEST_OUTPUTS.size(); ++i)
+        score += TEST_OUTPUTS[i].length() * CHAR_SIZE;
+
+    return score;
+}
+
+
+/* Checks the candidates in order, a batch at a time across the pool's threads, and replaces program with the first
+   one that still does what it should. Returns false if none of them do.
+   Any wrong output costs a candidate at least 1, and the cutoff is under 1 below what even the longest candidate
+   scores when it's right, so candidates are stopped at their first wrong character. Each one runs on the snapshot
+   of the one before it in the same place in the batch, and they tend to share most of their source, so most of each
+   run is skipped too. Whatever passes is then checked again in full, since a failed test case only costs what the
+   output it should have given would. */
+bool find_solving_candidate(const std::vector<std::string> &candidates, std::string &program, Population &batch,
+                            EvaluationPool &pool, Interpreter &brainfuck)
+{
+    std::vector<unsigned> jobs;
+
+    for(size_t first = 0; first < candidates.size(); first += MINIMIZE_BATCH)
+    {
+        size_t count = std::min<size_t>(MINIMIZE_BATCH, candidates.size() - first);
+        size_t longest = 0;
+
+        jobs.clear();
+
+        for(size_t i = 0; i < count; ++i)
+        {
+            const std::string &candidate = candidates[first + i];
+
+            batch.set_program(i, candidate.data(), candidate.length());
+            jobs.push_back(i);
+            longest = std::max(longest, candidate.length());
+        }
+
+        double cutoff = max_score() - longest * LENGTH_PENALTY - 0.5;
+
+        pool.evaluate(TEST_INPUTS.empty() ? calculate_fitness : calculate_test_fitness, cutoff, Interpreter::MAX_CYCLES, batch,
+                      jobs);
+        batch.clear_unscored();
+
+        for(size_t i = 0; i < count; ++i)
+        {
+            if(batch.scores()[i] >= cutoff && solves_goal(brainfuck, candidates[first + i]))
+            {
+                program = candidates[first + i];
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+
+/* Shorter versions of a program with pieces deleted, for delta debugging: first each half, then each quarter, and so
+   on down to every single character. */
+// Only keeps candidates at least MIN_PROGRAM_SIZE long, since the minimized program goes back into the population.
+void add_candidate(std::vector<std::string> &candidates, const std::string &candidate)
+{
+    if(candidate.length() >= MIN_PROGRAM_SIZE)
+        candidates.push_back(candidate);
+}
+
+
+void deletion_candidates(const std::string &program, std::vector<std::string> &candidates)
+{
+    for(size_t chunk = program.length() / 2; chunk >= 1; chunk /= 2)
+    {
+        for(size_t start = 0; start + chunk <= program.length(); start += (chunk > 1) ? chunk : 1)
+            add_candidate(candidates, program.substr(0, start) + program.substr(start + chunk));
+    }
+}
+
+
+/* Shorter versions of a program from rewriting what looks wasteful: pairs of instructions that undo each other (and
+   empty loops), runs of '+' and '-' that could add the same amount with fewer characters (cells wrap around at 256),
+   and everything after the last '.' or ']'. */
+void peephole_candidates(const std::string &program, std::vector<std::string> &candidates)
+{
+    static const char *PAIRS[] = {"+-", "-+", "<>", "><", "[]"};
+
+    for(size_t i = 0; i + 1 < program.length(); ++i)
+    {
+        for(size_t p = 0; p < sizeof(PAIRS) / sizeof(PAIRS[0]); ++p)
+        {
+            if(program.compare(i, 2, PAIRS[p]) == 0)
+                add_candidate(candidates, program.substr(0, i) + program.substr(i + 2));
+        }
+    }
+
+    for(size_t start = 0; start < program.length();)
+    {
+        size_t end = start;
+        int total = 0;
+
+        while(end < program.length() && (program[end] == '+' || program[end] == '-'))
+            total += (program[end++] == '+') ? 1 : -1;
+
+        if(end == start)
+        {
+            ++start;
+            continue;
+        }
+
+        total = ((total % 256) + 256) % 256;
+        std::string shortest = (total <= 128) ? std::string(total, '+') : std::string(256 - total, '-');
+
+        if(shortest.length() < end - start)
+            add_candidate(candidates, program.substr(0, start) + shortest + program.substr(end));
+
+        start = end;
+    }
+
+    size_t last = program.find_last_of(".]");
+    if(last != std::string::npos && last + 1 < program.length())
+        add_candidate(candidates, program.substr(0, last + 1));
+}
+
+
+// Shorter versions of a program from local search: every pair of neighbouring instructions, replaced by any one.
+void merge_candidates(const std::string &program, std::vector<std::string> &candidates)
+{
+    for(size_t i = 0; i + 1 < program.length(); ++i)
+    {
+        for(unsigned n = 0; n < NUM_INSTRUCTIONS; ++n)
+            add_candidate(candidates, program.substr(0, i) + INSTRUCTIONS[n] + program.substr(i + 2));
+    }
+}
+
+
+/* Searches for a shorter program that still does exactly what the given one does (outputs the goal output, or passes
+   every test case), rather than leaving it to the length penalty to slowly evolve one. Tries deleting pieces of it,
+   then rewriting wasteful bits, then merging neighbouring instructions, starting over from the top with whatever was
+   found each time something shorter turns up, until nothing does. Which shorter program is found is always the same
+   for a given program, whatever the number of threads. */
+std::string minimize_program(const std::string &program, unsigned num_threads, Interpreter::Backend backend)
+{
+    EvaluationPool pool(num_threads, backend);
+    Population batch(MINIMIZE_BATCH, std::max<unsigned>(MAX_PROGRAM_SIZE, program.length()));
+    Interpreter brainfuck(backend);
+    std::vector<std::string> candidates;
+    std::string shortest = program;
+
+    while(1)
+    {
+        candidates.clear();
+        deletion_candidates(shortest, candidates);
+
+        if(find_solving_candidate(candidates, shortest, batch, pool, brainfuck))
+            continue;
+
+        candidates.clear();
+        peephole_candidates(shortest, candidates);
+
+        if(find_solving_candidate(candidates, shortest, batch, pool, brainfuck))
+            continue;
+
+        candidates.clear();
+        merge_candidates(shortest, candidates);
+
+        if(!find_solving_candidate(candidates, shortest, batch, pool, brainfuck))
+            break;
+    }
+
+    return shortest;
+}
+
+
+// Which islands send their best programs to which.
+enum Topology
+{
+    RING,  // Each island only sends to the next one along, and the last one to the first.
+    FULLY_CONNECTED  // Each island sends to every other one.
+};
+
+// One of several populations evolving side by side, each on its own thread.
+struct Island
+{
+    Population population;
+    EvaluationPool pool;  // A pool of one, so scoring stays on the island's own thread.
+    FitnessCache cache;
+    Interpreter brainfuck;  // Used to check whether the island's best program is finished.
+    Random random;
+    std::atomic<unsigned long> generations;
+
+    /* Programs sent by other islands, one slot per sender. A sender swaps its newest program in (throwing away any
+       the island hadn't gotten to yet), and the island swaps it back out, so neither ever waits on the other. */
+    std::atomic<std::string *> *inbox;
+    unsigned num_islands;
+
+    std::thread thread;
+
+    Island(Interpreter::Backend backend, unsigned num_islands, const Random &random);
+    ~Island();
+};
+
+Island::Island(Interpreter::Backend backend, unsigned num_islands, const Random &random)
+    : population(POP_SIZE, MAX_PROGRAM_SIZE), pool(1, backend), cache(FITNESS_CACHE_SIZE), brainfuck(backend), random(random),
+      generations(0),
+      inbox(new std::atomic<std::string *>[num_islands]), num_islands(num_islands)
+{
+    for(unsigned i = 0; i < num_islands; ++i)
+        this->inbox[i] = NULL;
+}
+
+Island::~Island()
+{
+    for(unsigned i = 0; i < this->num_islands; ++i)
+        delete this->inbox[i].exchange(NULL);
+
+    delete[] this->inbox;
+}
+
+
+// Everything the islands share.
+struct Archipelago
+{
+    std::vector<Island *> islands;
+    Topology topology;
+    unsigned migration_rate;
+    std::atomic<bool> solved;  // Set by the first island to evolve a program with the goal output, telling the others to stop.
+    std::string solution;
+    unsigned solver;  // The island that evolved the solution.
+};
+
+
+// Sends the island's best program to its neighbours, and takes in whatever they have sent it.
+void migrate(Archipelago &archipelago, unsigned id, const std::string &best_program)
+{
+    Island &island = *archipelago.islands[id];
+    Population &population = island.population;
+    unsigned num_islands = archipelago.islands.size();
+
+    for(unsigned i = 1; i < num_islands; ++i)
+    {
+        if(archipelago.topology == RING && i > 1)
+            break;
+
+        Island &neighbour = *archipelago.islands[(id + i) % num_islands];
+        delete neighbour.inbox[id].exchange(new std::string(best_program));
+    }
+
+    for(unsigned i = 0; i < num_islands; ++i)
+    {
+        std::string *migrant = island.inbox[i].exchange(NULL);
+
+        if(!migrant)
+            continue;
+
+        /* Migrants take the place of the worst program, as long as it isn't also the best one.
+           Each is scored straight away, so the next migrant doesn't replace it in turn. */
+        if(!population.contains(migrant->data(), migrant->length()))
+        {
+            score_population(population, island.pool, island.cache);
+
+            if(population.worst() != population.best())
+            {
+                population.set_program(population.worst(), migrant->data(), migrant->length());
+                score_population(population, island.pool, island.cache);
+            }
+        }
+
+        delete migrant;
+    }
+}
+
+
+// Evolves one island until some island finds the goal output.
+void island_main(Archipelago &archipelago, unsigned id)
+{
+    Island &island = *archipelago.islands[id];
+
+    random_stream = &island.random;
+    initialize_population(island.population);
+
+    while(!archipelago.solved.load(std::memory_order_relaxed))
+    {
+        evolve_generation(island.population, island.pool, island.cache);
+        island.generations.store(island.generations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        if(island.generations % archipelago.migration_rate)
+            continue;
+
+        // The best program is checked here rather than every generation, since it means running it again.
+        score_population(island.population, island.pool, island.cache);
+        std::string best_program = island.population.program_string(island.population.best());
+
+        if(solves_goal(island.brainfuck, best_program))
+        {
+            if(!archipelago.solved.exchange(true))
+            {
+                archipelago.solution = best_program;
+                archipelago.solver = id;
+            }
+
+            break;
+        }
+
+        if(archipelago.islands.size() > 1)
+            migrate(archipelago, id, best_program);
+    }
+}
+
+
+/* Evolves several populations at once until one of them evolves the goal output, reporting the total generations
+   per second as it goes, then the time it took. Each island gets its own thread, and a stream of random numbers split from seed. */
+void run_islands(unsigned num_islands, Topology topology, unsigned migration_rate, Interpreter::Backend backend, uint64_t seed)
+{
+    Archipelago archipelago;
+    archipelago.topology = topology;
+    archipelago.migration_rate = migration_rate ? migration_rate : 1;
+    archipelago.solved = false;
+    archipelago.solver = 0;
+
+    Random random(seed);
+    for(unsigned i = 0; i < num_islands; ++i)
+        archipelago.islands.push_back(new Island(backend, num_islands, random.split()));
+
+    std::cout << "Seed: " << seed << ", islands: " << num_islands << " ("
+              << (topology == RING ? "ring" : "fully connected") << ", migrating every " << archipelago.migration_rate
+              << " generations)" << std::endl;
+
+    std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point next_report = start_time + std::chrono::seconds(ISLAND_DISPLAY_SECONDS);
+
+    for(unsigned i = 0; i < num_islands; ++i)
+        archipelago.islands[i]->thread = std::thread(island_main, std::ref(archipelago), i);
+
+    while(!archipelago.solved)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        if(std::chrono::steady_clock::now() < next_report)
+            continue;
+
+        unsigned long generations = 0;
+        for(unsigned i = 0; i < num_islands; ++i)
+            generations += archipelago.islands[i]->generations;
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        std::cout << "\nGeneration " << generations << " across all islands ("
+                  << static_cast<unsigned long>(generations / elapsed) << " per second)" << std::endl;
+
+        next_report += std::chrono::seconds(ISLAND_DISPLAY_SECONDS);
+    }
+
+    unsigned long generations = 0;
+
+    for(unsigned i = 0; i < num_islands; ++i)
+    {
+        archipelago.islands[i]->thread.join();
+        generations += archipelago.islands[i]->generations;
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+    std::cout << "\n\a\a\aProgram evolved on island " << archipelago.solver << " in " << elapsed << " seconds!" << std::endl;
+    std::cout << archipelago.solution << std::endl;
+    std::cout << "\n" << generations << " generations across all islands (" << static_cast<unsigned long>(generations / elapsed)
+              << " per second)" << std::endl;
+    std::cout << programs_failed << " of " << programs_run << " programs run failed ("
+              << (100.0 * programs_failed / std::max(1ul, programs_run.load())) << "%)";
+    report_cycle_tiers(std::cout);
+    std::cout << std::endl;
+
+    for(unsigned i = 0; i < num_islands; ++i)
+        delete archipelago.islands[i];
+}
+
+
+/* Turns the escapes in a test case back into the characters they stand for: \n, \t, \r, \\, and \xHH for any
+   character by its (two digit, hexadecimal) code. A backslash before anything else is left as it is. */
+std::string unescape(const std::string &text)
+{
+    std::string result;
+
+    for(size_t i = 0; i < text.length(); ++i)
+    {
+        if(text[i] != '\\' || i + 1 == text.length())
+        {
+            result += text[i];
+            continue;
+        }
+
+        char code = text[i + 1];
+
+        if(code == 'n')
+            result += '\n';
+        else if(code == 't')
+            result += '\t';
+        else if(code == 'r')
+            result += '\r';
+        else if(code == '\\')
+            result += '\\';
+        else if(code == 'x' && i + 3 < text.length() && isxdigit(text[i + 2]) && isxdigit(text[i + 3]))
+        {
+            result += static_cast<char>(strtoul(text.substr(i + 2, 2).c_str(), NULL, 16));
+            i += 2;
+        }
+        else
+        {
+            result += text[i];
+            continue;
+        }
+
+        ++i;
+    }
+
+    return result;
+}
+
+
+// The opposite of unescape(), so that any text can be written on a single tab-separated line.
+std::string escape(const std::string &text)
+{
+    const char HEX_DIGITS[] = "0123456789abcdef";
+    std::string result;
+
+    for(size_t i = 0; i < text.length(); ++i)
+    {
+        unsigned char c = text[i];
+
+        if(c == '\n')
+            result += "\\n";
+        else if(c == '\t')
+            result += "\\t";
+        else if(c == '\r')
+            result += "\\r";
+        else if(c == '\\')
+            result += "\\\\";
+        else if(c < ' ' || c > '~')
+        {
+            result += "\\x";
+            result += HEX_DIGITS[c >> 4];
+            result += HEX_DIGITS[c & 15];
+        }
+        else
+            result += c;
+    }
+
+    return result;
+}
+
+
+/* Reads test cases from a file, one per line: the input, a tab, and then the output that input should give.
+   Both can use the escapes unescape() understands. Blank lines and lines starting with '#' are skipped. */
+bool read_tests(const std::string &filename)
+{
+    std::ifstream file(filename.c_str());
+    std::string line;
+
+    if(!file)
+        return false;
+
+    while(std::getline(file, line))
+    {
+        if(!line.empty() && line[line.length() - 1] == '\r')
+            line.erase(line.length() - 1);
+
+        if(line.empty() || line[0] == '#')
+            continue;
+
+        size_t tab = line.find('\t');
+
+        if(tab == std::string::npos)
+            return false;
+
+        TEST_INPUTS.push_back(unescape(line.substr(0, tab)));
+        TEST_OUTPUTS.push_back(unescape(line.substr(tab + 1)));
+    }
+
+    return !TEST_INPUTS.empty();
+}
+
+
+/* Reads the goal outputs for batch mode, one per line, from a file (or standard input, if the filename is "-").
+   Goals can use the escapes unescape() understands. Blank lines and lines starting with '#' are skipped. */
+bool read_goals(const std::string &filename, std::vector<std::string> &goals)
+{
+    std::ifstream file;
+    std::istream &in = (filename == "-") ? std::cin : file;
+    std::string line;
+
+    if(filename != "-")
+        file.open(filename.c_str());
+
+    if(!in)
+        return false;
+
+    while(std::getline(in, line))
+    {
+        if(!line.empty() && line[line.length() - 1] == '\r')
+            line.erase(line.length() - 1);
+
+        if(line.empty() || line[0] == '#')
+            continue;
+
+        goals.push_back(unescape(line));
+    }
+
+    return !goals.empty();
+}
+
+
+// How evolving a program for a goal went.
+struct GoalResult
+{
+    std::string best_program;
+    unsigned long generations;
+    double seconds;
+    bool solved;
+};
+
+
+/* Evolves a fresh population for a goal, until its best program outputs the goal or it reaches either limit (0 for
+   none). Everything it needs is passed in, since goal_output and random_stream are only set for the calling thread. */
+GoalResult evolve_goal(const std::string &goal, Random &stream, unsigned long max_generations, double max_seconds,
+                       EvaluationPool &pool, FitnessCache &cache, Interpreter &brainfuck)
+{
+    goal_output = &goal;
+    random_stream = &stream;
+    cache.clear();
+
+    std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+    Population population(POP_SIZE, MAX_PROGRAM_SIZE);
+    GoalResult result;
+
+    result.generations = 0;
+    result.seconds = 0;
+    result.solved = false;
+
+    initialize_population(population);
+
+    while(1)
+    {
+        evolve_generation(population, pool, cache);
+        ++result.generations;
+
+        if(result.generations % BATCH_CHECK_RATE && result.generations != max_generations)
+            continue;
+
+        score_population(population, pool, cache);
+        result.best_program = population.program_string(population.best());
+        result.solved = solves_goal(brainfuck, result.best_program);
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+        if(result.solved || (max_generations && result.generations >= max_generations) ||
+           (max_seconds > 0 && result.seconds >= max_seconds))
+            break;
+    }
+
+    goal_output = &GOAL_OUTPUT;
+    random_stream = NULL;
+
+    return result;
+}
+
+
+// A list of goal outputs to evolve programs for, without anyone there to answer questions.
+struct Batch
+{
+    std::vector<std::string> goals;
+    std::vector<Random> streams;  // The random numbers for each goal, so its job goes the same whichever thread takes it.
+    std::atomic<size_t> next_goal;  // The next goal for a worker to take.
+
+    // Jobs stop once they reach either limit, if they haven't evolved a program for their goal before then. 0 means none.
+    unsigned long max_generations;
+    double max_seconds;
+
+    std::ostream *results;
+    std::mutex results_lock;  // Guards results, so each job's line is written in one piece.
+    std::atomic<size_t> solved;
+    std::atomic<unsigned long> generations;
+};
+
+
+/* Takes jobs from the batch until there are none left. Each job evolves a program for its goal (see evolve_goal()),
+   then writes a line to the results: the goal (escaped), the best program, how many generations it took, how many
+   seconds, and whether it was "solved" or "unsolved".
+   Everything a job needs is kept on this thread, with a pool of one, since goal_output is only set for this thread. */
+void batch_worker(Batch &batch, Interpreter::Backend backend)
+{
+    EvaluationPool pool(1, backend);
+    FitnessCache cache(FITNESS_CACHE_SIZE);
+    Interpreter brainfuck(backend);
+
+    for(size_t job = batch.next_goal++; job < batch.goals.size(); job = batch.next_goal++)
+    {
+        GoalResult result = evolve_goal(batch.goals[job], batch.streams[job], batch.max_generations, batch.max_seconds, pool,
+                                        cache, brainfuck);
+
+        batch.solved += result.solved;
+        batch.generations += result.generations;
+
+        std::lock_guard<std::mutex> lock(batch.results_lock);
+        *batch.results << escape(batch.goals[job]) << '\t' << result.best_program << '\t' << result.generations << '\t'
+                       << result.seconds << '\t' << (result.solved ? "solved" : "unsolved") << std::endl;
+    }
+}
+
+
+/* Evolves a program for every goal in the file, non-interactively, as jobs spread across num_workers threads.
+   Results are written to results_file (or standard output, if it's empty or "-") as each job finishes, so they
+   may not be in the same order as the goals. A summary goes to standard error at the end. */
+bool run_batch(const std::string &goals_file, const std::string &results_file, unsigned num_workers,
+               unsigned long max_generations, double max_seconds, Interpreter::Backend backend, uint64_t seed)
+{
+    Batch batch;
+    std::ofstream file;
+
+    if(!read_goals(goals_file, batch.goals))
+    {
+        std::cerr << "Couldn't read any goals from '" << goals_file << "'." << std::endl;
+        return false;
+    }
+
+    if(!results_file.empty() && results_file != "-")
+    {
+        file.open(results_file.c_str());
+
+        if(!file)
+        {
+            std::cerr << "Couldn't write results to '" << results_file << "'." << std::endl;
+            return false;
+        }
+    }
+
+    Random random(seed);
+    for(size_t i = 0; i < batch.goals.size(); ++i)
+        batch.streams.push_back(random.split());
+
+    batch.next_goal = 0;
+    batch.max_generations = max_generations;
+    batch.max_seconds = max_seconds;
+    batch.results = file.is_open() ? static_cast<std::ostream *>(&file) : &std::cout;
+    batch.solved = 0;
+    batch.generations = 0;
+
+    num_workers = std::max(1u, std::min<unsigned>(num_workers, batch.goals.size()));
+    std::cerr << "Seed: " << seed << ", goals: " << batch.goals.size() << ", threads: " << num_workers << std::endl;
+
+    std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+
+    // The calling thread works on the batch too, like the evaluation pool's does.
+    for(unsigned i = 1; i < num_workers; ++i)
+        workers.push_back(std::thread(batch_worker, std::ref(batch), backend));
+
+    batch_worker(batch, backend);
+
+    for(size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+    std::cerr << batch.solved << " of " << batch.goals.size() << " goals solved in " << elapsed << " seconds ("
+              << static_cast<unsigned long>(batch.generations / elapsed) << " generations per second)" << std::endl;
+
+    return true;
+}
+
+
+// Takes a program's output and throws it away, for when only running the program matters.
+class NullSink : public Interpreter::OutputSink
+{
+public:
+    bool put(unsigned char)
+    {
+        return true;
+    }
+};
+
+
+// The nanoseconds each of a number of operations took on average, since start.
+double ns_per_op(std::chrono::steady_clock::time_point start, unsigned long operations)
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / operations;
+}
+
+
+/* Makes a corpus of random programs for the interpreter benchmarks. "random" programs are made the way the first
+   generation's are, brackets and all, so most of them fail. "looping" programs have their brackets matched, so they
+   run their loops. "timeout" programs have a loop that never ends ("+[]") added to the end, so most of them
+   use up every cycle. */
+std::vector<std::string> make_corpus(const std::string &kind)
+{
+    std::vector<std::string> corpus;
+    std::vector<char> program(MAX_PROGRAM_SIZE);
+    bool bracket_aware = BRACKET_AWARE;
+
+    BRACKET_AWARE = (kind != "random");
+
+    for(unsigned i = 0; i < BENCHMARK_CORPUS_SIZE; ++i)
+    {
+        corpus.push_back(std::string(&program[0], create_random_program(&program[0])));
+
+        if(kind == "timeout")
+            corpus.back() += "+[]";
+    }
+
+    BRACKET_AWARE = bracket_aware;
+
+    return corpus;
+}
+
+
+/* Times the parts of evolution that decide how fast it goes, on workloads that are the same every time for a given
+   seed, and writes the results as JSON, so that backends (and changes) can be compared by their numbers:
+        -Interpreter::run() and calculate_fitness() on each corpus (see make_corpus()), in nanoseconds per program and
+         cycles per second. Each program is scored on the snapshot of a different one, like a child that shares
+         little with its parent.
+        -select_parent(), mutate() (on a copy of a program, which is timed too) and mate() at several population sizes.
+        -How long evolving a program for each of a few goals takes, up to the --max-generations and --max-seconds
+         given (BENCHMARK_MAX_SECONDS by default).
+   Everything runs on this thread alone. */
+bool run_benchmarks(const std::string &results_file, unsigned long max_generations, double max_seconds,
+                    Interpreter::Backend backend, uint64_t seed)
+{
+    static const char *CORPORA[] = {"random", "looping", "timeout"};
+    static const unsigned POPULATION_SIZES[] = {1000, 10000, 100000};
+    static const char *GOALS[] = {"Hi", "Hello", "Hello, world!"};
+
+    std::ofstream file;
+    std::ostream *results = &std::cout;
+
+    if(!results_file.empty() && results_file != "-")
+    {
+        file.open(results_file.c_str());
+
+        if(!file)
+        {
+            std::cerr << "Couldn't write benchmark results to '" << results_file << "'." << std::endl;
+            return false;
+        }
+
+        results = &file;
+    }
+
+    if(!max_generations && max_seconds <= 0)
+        max_seconds = BENCHMARK_MAX_SECONDS;
+
+    Random random(seed);
+    Interpreter brainfuck(backend);
+    std::string goal = "Hello, world!";  // What calculate_fitness() scores against.
+    bool first = true;
+
+    *results << "{\"seed\": " << seed << ", \"backend\": \"" << ((backend == Interpreter::NATIVE) ? "native" : "bytecode")
+             << "\", \"benchmarks\": [";
+
+    for(size_t c = 0; c < sizeof(CORPORA) / sizeof(CORPORA[0]); ++c)
+    {
+        random_stream = &random;
+        std::vector<std::string> corpus = make_corpus(CORPORA[c]);
+        std::vector<Interpreter::Snapshot> snapshots(corpus.size());
+        unsigned long cycles = 0;
+        NullSink sink;
+
+        // A first pass fills in each program's snapshot, which is where the cycles it takes are counted.
+        for(size_t i = 0; i < corpus.size(); ++i)
+        {
+            brainfuck.run(corpus[i].data(), corpus[i].length(), snapshots[i], sink);
+            cycles += snapshots[i].cycles;
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        for(unsigned pass = 0; pass < BENCHMARK_PASSES; ++pass)
+        {
+            for(size_t i = 0; i < corpus.size(); ++i)
+                brainfuck.run(corpus[i]);
+        }
+
+        double run_ns = ns_per_op(start, BENCHMARK_PASSES * corpus.size());
+
+        goal_output = &goal;
+        start = std::chrono::steady_clock::now();
+
+        for(unsigned pass = 0; pass < BENCHMARK_PASSES; ++pass)
+        {
+            for(size_t i = 0; i < corpus.size(); ++i)
+            {
+                Interpreter::Snapshot &snapshot = snapshots[(i + pass + 1) % snapshots.size()];
+                calculate_fitness(corpus[i].data(), corpus[i].length(), -HUGE_VAL, Interpreter::MAX_CYCLES, brainfuck, snapshot);
+            }
+        }
+
+        double fitness_ns = ns_per_op(start, BENCHMARK_PASSES * corpus.size());
+        goal_output = &GOAL_OUTPUT;
+
+        double cycles_per_program = static_cast<double>(cycles) / corpus.size();
+
+        *results << (first ? "" : ",") << "\n  {\"name\": \"interpreter\", \"corpus\": \"" << CORPORA[c]
+                 << "\", \"ns_per_op\": " << run_ns << ", \"cycles_per_second\": " << (cycles_per_program * 1e9 / run_ns) << "}";
+        *results << ",\n  {\"name\": \"fitness\", \"corpus\": \"" << CORPORA[c] << "\", \"ns_per_op\": " << fitness_ns
+                 << ", \"cycles_per_second\": " << (cycles_per_program * 1e9 / fitness_ns) << "}";
+        first = false;
+    }
+
+    for(size_t s = 0; s < sizeof(POPULATION_SIZES) / sizeof(POPULATION_SIZES[0]); ++s)
+    {
+        unsigned size = POPULATION_SIZES[s];
+        Population population(size, MAX_PROGRAM_SIZE);
+        std::vector<char> child(MAX_PROGRAM_SIZE);
+        std::vector<std::pair<unsigned, unsigned> > parents;
+
+        random_stream = &random;
+        initialize_population(population);
+
+        for(unsigned id = 0; id < size; ++id)
+            population.set_score(id, get_random(ERROR_SCORE, 1000.0));
+
+        population.clear_unscored();
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        for(unsigned long i = 0; i < BENCHMARK_OPERATIONS; ++i)
+            select_parent(population);
+
+        double select_ns = ns_per_op(start, BENCHMARK_OPERATIONS);
+
+        start = std::chrono::steady_clock::now();
+
+        for(unsigned long i = 0; i < BENCHMARK_OPERATIONS; ++i)
+        {
+            unsigned id = i % size;
+            unsigned length = population.length(id);
+
+            memcpy(&child[0], population.program(id), length);
+            mutate(&child[0], length);
+        }
+
+        double mutate_ns = ns_per_op(start, BENCHMARK_OPERATIONS);
+
+        // The parents are picked beforehand, so only mating is timed.
+        for(unsigned long i = 0; i < BENCHMARK_OPERATIONS; ++i)
+        {
+            unsigned parent1 = get_random_int(0, size - 1);
+            unsigned parent2 = get_random_int(0, size - 2);
+
+            parents.push_back(std::make_pair(parent1, parent2 + (parent2 >= parent1)));
+        }
+
+        start = std::chrono::steady_clock::now();
+
+        for(unsigned long i = 0; i < BENCHMARK_OPERATIONS; ++i)
+            mate(population, parents[i].first, parents[i].second);
+
+        double mate_ns = ns_per_op(start, BENCHMARK_OPERATIONS);
+
+        *results << ",\n  {\"name\": \"select_parent\", \"population\": " << size << ", \"ns_per_op\": " << select_ns << "}";
+        *results << ",\n  {\"name\": \"mutate\", \"population\": " << size << ", \"ns_per_op\": " << mutate_ns << "}";
+        *results << ",\n  {\"name\": \"mate\", \"population\": " << size << ", \"ns_per_op\": " << mate_ns << "}";
+    }
+
+    EvaluationPool pool(1, backend);
+    FitnessCache cache(FITNESS_CACHE_SIZE);
+
+    for(size_t g = 0; g < sizeof(GOALS) / sizeof(GOALS[0]); ++g)
+    {
+        std::string goal = GOALS[g];
+        Random stream = random.split();
+        GoalResult result = evolve_goal(goal, stream, max_generations, max_seconds, pool, cache, brainfuck);
+
+        *results << ",\n  {\"name\": \"evolve\", \"goal\": \"" << goal << "\", \"solved\": " << (result.solved ? "true" : "false")
+                 << ", \"generations\": " << result.generations << ", \"seconds\": " << result.seconds
+                 << ", \"ns_per_generation\": " << (result.seconds * 1e9 / result.generations) << "}";
+    }
+
+    *results << "\n]}" << std::endl;
+    random_stream = NULL;
+
+    return true;
+}
+
+
+/* Runs a program from scratch, and describes how it ended: whether it failed (and if so, whether by running out of
+   cycles), how many cycles it ran for, and what it output. Runs that should be indistinguishable are described alike. */
+std::string describe_run(Interpreter &bf, const std::string &program, unsigned max_cycles)
+{
+    Interpreter::Snapshot snapshot;
+    NullSink sink;
+    bool ok = bf.run(program.data(), program.length(), snapshot, sink, max_cycles);
+
+    return std::string(ok ? "finished" : (snapshot.out_of_cycles ? "ran out of cycles" : "failed")) + " after " +
+           std::to_string(snapshot.cycles) + " cycles, outputting \"" + snapshot.output + "\"";
+}
+
+
+// Shows the program a self-test failed on, and how it went compared to how it should have.
+void report_mismatch(const char *test, const std::string &program, const std::string &expected, const std::string &actual)
+{
+    std::cout << test << ": FAILED on " << program << std::endl;
+    std::cout << "    expected: " << expected << std::endl;
+    std::cout << "    got:      " << actual << std::endl;
+}
+
+
+/* Every program of every benchmark corpus has to run exactly the same with the interpreter's loop idioms as with
+   the loops run one character at a time, both with every cycle and with the fewest a cycle tier gives. */
+bool test_loop_idioms()
+{
+    static const char *CORPORA[] = {"random", "looping", "timeout"};
+    static const unsigned BUDGETS[] = {MIN_CYCLE_BUDGET, Interpreter::MAX_CYCLES};
+
+    Interpreter with_idioms;
+    Interpreter without_idioms;
+    unsigned long runs = 0;
+
+    without_idioms.set_loop_idioms(false);
+
+    for(size_t c = 0; c < sizeof(CORPORA) / sizeof(CORPORA[0]); ++c)
+    {
+        std::vector<std::string> corpus = make_corpus(CORPORA[c]);
+
+        for(size_t i = 0; i < corpus.size(); ++i)
+        {
+            for(size_t b = 0; b < sizeof(BUDGETS) / sizeof(BUDGETS[0]); ++b)
+            {
+                std::string expected = describe_run(without_idioms, corpus[i], BUDGETS[b]);
+                std::string actual = describe_run(with_idioms, corpus[i], BUDGETS[b]);
+
+                if(actual != expected)
+                {
+                    report_mismatch("Loop idioms", corpus[i], expected, actual);
+                    return false;
+                }
+
+                ++runs;
+            }
+        }
+    }
+
+    std::cout << "Loop idioms: " << runs << " runs matched" << std::endl;
+
+    return true;
+}
+
+
+/* Scores a program against the goal output, from whatever its snapshot holds, and describes how that went: its score,
+   whether it ran out of cycles, how many cycles it ran for, and what it output. The score itself is passed back, to be
+   compared exactly. */
+std::string describe_fitness(Interpreter &bf, const std::string &program, unsigned max_cycles, Interpreter::Snapshot &snapshot,
+                             double &score)
+{
+    score = calculate_fitness(program.data(), program.length(), -HUGE_VAL, max_cycles, bf, snapshot);
+
+    return "scored " + std::to_string(score) + (score == ERROR_SCORE ? " (an error)" : "") +
+           (snapshot.out_of_cycles ? ", running out of cycles" : "") + " after " + std::to_string(snapshot.cycles) +
+           " cycles, outputting \"" + snapshot.output + "\"";
+}
+
+
+/* Every program of every benchmark corpus has to score exactly the same in its canonical form (see --canonical) as
+   it is, both with every cycle and with the fewest a cycle tier gives, and its run has to end the same way. */
+bool test_canonical_programs()
+{
+    static const char *CORPORA[] = {"random", "looping", "timeout"};
+    static const unsigned BUDGETS[] = {MIN_CYCLE_BUDGET, Interpreter::MAX_CYCLES};
+
+    Interpreter bf;
+    unsigned long scorings = 0;
+
+    for(size_t c = 0; c < sizeof(CORPORA) / sizeof(CORPORA[0]); ++c)
+    {
+        std::vector<std::string> corpus = make_corpus(CORPORA[c]);
+
+        for(size_t i = 0; i < corpus.size(); ++i)
+        {
+            // Copied, as canonical_program() reuses its buffer.
+            std::string canonical(canonical_program(corpus[i].data(), corpus[i].length()), corpus[i].length());
+
+            for(size_t b = 0; b < sizeof(BUDGETS) / sizeof(BUDGETS[0]); ++b)
+            {
+                Interpreter::Snapshot original_snapshot;
+                Interpreter::Snapshot canonical_snapshot;
+                double expected_score;
+                double actual_score;
+                std::string expected = describe_fitness(bf, corpus[i], BUDGETS[b], original_snapshot, expected_score);
+                std::string actual = describe_fitness(bf, canonical, BUDGETS[b], canonical_snapshot, actual_score);
+
+                if(actual_score != expected_score || actual != expected)
+                {
+                    report_mismatch("Canonical programs", corpus[i] + " (canonically " + canonical + ")", expected, actual);
+                    return false;
+                }
+
+                ++scorings;
+            }
+        }
+    }
+
+    std::cout << "Canonical programs: " << scorings << " scorings matched" << std::endl;
+
+    return true;
+}
+
+
+/* Every program of every benchmark corpus has to score exactly the same with each cycle tier's budget when its snapshot
+   is left over from a run with every cycle (as evaluate_in_tiers() does to children that inherit their parent's) as
+   it does from scratch. Checkpoints taken later than the budget allows mustn't be resumed from. */
+bool test_snapshot_budgets()
+{
+    static const char *CORPORA[] = {"random", "looping", "timeout"};
+
+    Interpreter bf;
+    unsigned long scorings = 0;
+
+    for(size_t c = 0; c < sizeof(CORPORA) / sizeof(CORPORA[0]); ++c)
+    {
+        std::vector<std::string> corpus = make_corpus(CORPORA[c]);
+
+        for(size_t i = 0; i < corpus.size(); ++i)
+        {
+            for(unsigned budget = MIN_CYCLE_BUDGET; budget < Interpreter::MAX_CYCLES; budget *= 2)
+            {
+                Interpreter::Snapshot fresh;
+                Interpreter::Snapshot resumed;
+                double expected_score;
+                double actual_score;
+
+                describe_fitness(bf, corpus[i], Interpreter::MAX_CYCLES, resumed, actual_score);
+
+                std::string expected = describe_fitness(bf, corpus[i], budget, fresh, expected_score);
+                std::string actual = describe_fitness(bf, corpus[i], budget, resumed, actual_score);
+
+                if(actual_score != expected_score || actual != expected)
+                {
+                    report_mismatch("Snapshot budgets", corpus[i] + " (with " + std::to_string(budget) + " cycles)",
+                                    expected, actual);
+                    return false;
+                }
+
+                ++scorings;
+            }
+        }
+    }
+
+    std::cout << "Snapshot budgets: " << scorings << " scorings matched" << std::endl;
+
+    return true;
+}
+
+
+/* Once a population has evolved for a while, and every buffer has grown as big as it needs to be, evolving it
+   shouldn't allocate any memory at all, a generation at a time (see --generational) or two children at a time.
+   The exception is the programs' snapshots, which are only as big as they have needed to be so far, to save memory. */
+bool test_allocations()
+{
+    bool generational_mode = GENERATIONAL;
+    bool passed = true;
+
+    for(int generational = 0; generational < 2; ++generational)
+    {
+        const char *name = generational ? "Allocations (--generational)" : "Allocations";
+        Population population(SELF_TEST_POPULATION, MAX_PROGRAM_SIZE);
+        EvaluationPool pool(1, Interpreter::BYTECODE);
+        FitnessCache cache(FITNESS_CACHE_SIZE);
+        // Each call to breed_generation() breeds a whole population's worth of children, so it gets fewer calls.
+        unsigned long generations = generational ? SELF_TEST_GENERATIONS / SELF_TEST_POPULATION : SELF_TEST_GENERATIONS;
+        unsigned long before = 0;
+
+        GENERATIONAL = generational;
+        initialize_population(population);
+
+        for(unsigned long i = 0; i < 2 * generations; ++i)
+        {
+            if(i == generations)
+            {
+                /* Snapshots grow as big as the programs in their slot need, which can still happen long into a run,
+                   so they're made as big as they can get before counting, to see that nothing else allocates. */
+                for(unsigned id = 0; id < population.size(); ++id)
+                    population.snapshot(id).reserve(MAX_PROGRAM_SIZE);
+
+                before = allocation_count();
+            }
+
+            if(GENERATIONAL)
+                breed_generation(population, pool, cache);
+            else
+                evolve_generation(population, pool, cache);
+        }
+
+        unsigned long allocated = allocation_count() - before;
+
+        std::cout << name << ": " << allocated << " in " << generations << " generations, after as many to warm up";
+        std::cout << (allocated ? " (FAILED)" : "") << std::endl;
+
+        passed = passed && !allocated;
+    }
+
+    GENERATIONAL = generational_mode;
+
+    return passed;
+}
+
+
+// The flag the self-test's farm workers race to claim, in memory they all share, and the process they were forked from.
+std::atomic<bool> *worker_killed = NULL;
+pid_t farm_coordinator = 0;
+
+/* Scores programs just like calculate_fitness(), except that the first of the self-test's worker processes to get
+   through SELF_TEST_KILL_AFTER programs kills itself before the next, in the middle of whatever it was sent. */
+double calculate_fitness_or_die(const char *program, unsigned length, double cutoff, unsigned max_cycles, Interpreter &bf,
+                                Interpreter::Snapshot &snapshot)
+{
+    static unsigned scored = 0;  // Per process, since each worker has its own copy.
+
+    if(getpid() != farm_coordinator && ++scored > SELF_TEST_KILL_AFTER && !worker_killed->exchange(true))
+        raise(SIGKILL);
+
+    return calculate_fitness(program, length, cutoff, max_cycles, bf, snapshot);
+}
+
+
+/* Describes a program's score, and as much of how its run ended as an evaluation farm passes back: whether it ran out
+   of cycles, and how many it ran for out of how many it was allowed. */
+std::string describe_scoring(double score, const Interpreter::Snapshot &snapshot)
+{
+    return "scored " + std::to_string(score) + (snapshot.out_of_cycles ? ", running out of cycles" : "") + " after " +
+           std::to_string(snapshot.cycles) + " of " + std::to_string(snapshot.max_cycles) + " cycles";
+}
+
+
+/* Scoring a population in an evaluation farm's worker processes has to give every program exactly the same score,
+   and leave its run ending the same way, as scoring it across the evaluation pool's threads, even when one of the
+   workers dies partway through a batch. Every program is scored with every cycle and with the fewest a cycle tier
+   gives, so the second batch is scored by the workers that are left. */
+bool test_evaluation_farm()
+{
+    static const unsigned BUDGETS[] = {Interpreter::MAX_CYCLES, MIN_CYCLE_BUDGET};
+
+    void *shared = mmap(NULL, sizeof(std::atomic<bool>), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if(shared == MAP_FAILED)
+    {
+        std::cout << "Evaluation farm: FAILED to share memory with the workers" << std::endl;
+        return false;
+    }
+
+    worker_killed = new(shared) std::atomic<bool>(false);
+    farm_coordinator = getpid();
+
+    bool passed = true;
+    unsigned long scorings = 0;
+
+    {
+        // The workers are forked before the pool starts any threads.
+        EvaluationFarm farm(SELF_TEST_WORKERS, Interpreter::BYTECODE, calculate_fitness_or_die);
+        EvaluationPool pool(1, Interpreter::BYTECODE);
+        Population population(SELF_TEST_POPULATION, MAX_PROGRAM_SIZE);
+        std::vector<unsigned> jobs;
+        std::vector<std::string> expected(population.size());
+
+        initialize_population(population);
+
+        for(unsigned i = 0; i < population.size(); ++i)
+            jobs.push_back(i);
+
+        for(size_t b = 0; passed && b < sizeof(BUDGETS) / sizeof(BUDGETS[0]); ++b)
+        {
+            pool.evaluate(calculate_fitness, -HUGE_VAL, BUDGETS[b], population, jobs);
+
+            for(unsigned i = 0; i < population.size(); ++i)
+            {
+                expected[i] = describe_scoring(population.scores()[i], population.snapshot(i));
+                population.scores()[i] = NAN;  // So that any program the farm skips can't pass for scored.
+            }
+
+            farm.evaluate(-HUGE_VAL, BUDGETS[b], population, jobs);
+
+            for(unsigned i = 0; passed && i < population.size(); ++i)
+            {
+                std::string actual = describe_scoring(population.scores()[i], population.snapshot(i));
+
+                if(actual != expected[i])
+                {
+                    report_mismatch("Evaluation farm", population.program_string(i), expected[i], actual);
+                    passed = false;
+                }
+
+                ++scorings;
+            }
+        }
+
+        if(passed && farm.size() != SELF_TEST_WORKERS - 1)
+        {
+            std::cout << "Evaluation farm: FAILED, " << farm.size() << " of " << SELF_TEST_WORKERS
+                      << " workers left after killing one" << std::endl;
+            passed = false;
+        }
+    }
+
+    munmap(shared, sizeof(std::atomic<bool>));
+    worker_killed = NULL;
+
+    if(passed)
+        std::cout << "Evaluation farm: " << scorings << " scorings matched, with one of " << SELF_TEST_WORKERS
+                  << " workers killed" << std::endl;
+
+    return passed;
+}
+
+
+/* Checks that what's only there to make evolution faster doesn't change what it does, on programs made the same way
+   every time for a given seed. Each check reports on a line of its own, and stops at the first program it fails on.
+   Returns false if any of them failed. */
+bool run_self_tests(uint64_t seed)
+{
+    Random random(seed);
+    bool passed = true;
+
+    random_stream = &random;
+    std::cout << "Seed: " << seed << std::endl;
+
+    passed = test_loop_idioms() && passed;
+    passed = test_canonical_programs() && passed;
+    passed = test_snapshot_budgets() && passed;
+    passed = test_allocations() && passed;
+    passed = test_evaluation_farm() && passed;
+
+    random_stream = NULL;
+    std::cout << (passed ? "All self-tests passed" : "Some self-tests FAILED") << std::endl;
+
+    return passed;
+}
+
+
+/* Replays a lineage log written with --lineage, and shows how the run's programs came about: how often each kind of
+   mutation happened, how often children did better than both their parents (with crossover alone, and with each
+   kind of mutation), and the latest of the programs that were the best so far when they were first scored. */
+bool query_lineage(const std::string &filename)
+{
+    static const char *EDIT_NAMES[] = {"changes", "insertions", "deletions", "loops added", "loops removed"};
+
+    // What's known about a child from its mating, until it is scored.
+    struct Child
+    {
+        bool pending;  // Whether it came from a mating, and hasn't been scored yet.
+        unsigned long generation;
+        double parents_score;  // The better of its parents' scores.
+        unsigned edits;
+        unsigned edit_types;  // A bit for each type of edit it had.
+        const char *origin;  // Where it came from, if not from a mating.
+    };
+
+    struct Milestone
+    {
+        unsigned long generation;
+        double score;
+        size_t length;
+        std::string origin;
+    };
+
+    LineageReader reader;
+
+    if(!reader.open(filename))
+    {
+        std::cerr << "Couldn't read lineage log '" << filename << "'" << std::endl;
+        return false;
+    }
+
+    std::vector<Child> children;
+    std::vector<Milestone> milestones;  // Only the latest LINEAGE_MILESTONES are kept.
+    unsigned long milestones_found = 0;
+    unsigned long first_generation = 0;
+    unsigned long starts = 0;
+    unsigned long matings = 0;
+    unsigned long elite_copies = 0;
+    unsigned long programs_put_in = 0;
+    unsigned long edit_counts[LineageEdit::NUM_TYPES] = {0};
+    unsigned long scored[LineageEdit::NUM_TYPES + 1] = {0};  // Children scored after each type of edit, and with none.
+    unsigned long improved[LineageEdit::NUM_TYPES + 1] = {0};  // The ones of those that beat both parents.
+    double best_score = -HUGE_VAL;
+
+    while(reader.next())
+    {
+        const std::vector<unsigned> &changed = reader.changed();
+
+        switch(reader.type())
+        {
+        case LineageReader::POPULATION:
+        {
+            Child child = {false, 0, 0, 0, 0, starts ? "in a resumed population" : "in the starting population"};
+
+            if(!starts++)
+                first_generation = reader.generation();
+
+            children.assign(reader.size(), child);
+            break;
+        }
+        case LineageReader::MATING:
+        {
+            const LineageReader::Mating &mating = reader.mating();
+            double parents_score = std::max(reader.score(mating.parent1), reader.score(mating.parent2));
+
+            for(unsigned c = 0; c < NUM_CHILDREN; ++c)
+            {
+                Child child = {true, mating.generation, parents_score, 0, 0, NULL};
+                children[c ? mating.parent2 : mating.parent1] = child;
+            }
+
+            for(size_t i = 0; i < mating.edits.size(); ++i)
+            {
+                Child &child = children[mating.edits[i].child ? mating.parent2 : mating.parent1];
+
+                ++edit_counts[mating.edits[i].type];
+                ++child.edits;
+                child.edit_types |= 1 << mating.edits[i].type;
+            }
+
+            ++matings;
+            break;
+        }
+        case LineageReader::ELITE:
+        case LineageReader::PROGRAM:
+        {
+            bool elite = (reader.type() == LineageReader::ELITE);
+
+            children[changed[0]].pending = false;
+            children[changed[0]].origin = elite ? "copied by elitism" : "put in from outside";
+            ++(elite ? elite_copies : programs_put_in);
+            break;
+        }
+        case LineageReader::SCORES:
+            for(size_t i = 0; i < changed.size(); ++i)
+            {
+                unsigned id = changed[i];
+                Child &child = children[id];
+                double score = reader.score(id);
+
+                if(child.pending)
+                {
+                    for(unsigned type = 0; type <= LineageEdit::NUM_TYPES; ++type)
+                    {
+                        if((type == LineageEdit::NUM_TYPES) ? !child.edit_types : (child.edit_types & (1 << type)))
+                        {
+                            ++scored[type];
+                            improved[type] += (score > child.parents_score);
+                        }
+                    }
+                }
+
+                if(score > best_score)
+                {
+                    Milestone milestone = {reader.generation(), score, reader.program(id).length(), child.pending ? "" : child.origin};
+
+                    if(child.pending)
+                    {
+                        milestone.generation = child.generation;
+                        milestone.origin = child.edits ? "from crossover and " + std::to_string(child.edits) + " mutations"
+                                                       : "from crossover alone";
+                    }
+
+                    if(milestones.size() == LINEAGE_MILESTONES)
+                        milestones.erase(milestones.begin());
+
+                    milestones.push_back(milestone);
+                    ++milestones_found;
+                    best_score = score;
+                }
+
+                child.pending = false;
+            }
+            break;
+        }
+    }
+
+    if(!reader.finished())
+        std::cerr << "The end of the log is damaged or unfinished, so it was left out." << std::endl;
+
+    if(!reader.size())
+    {
+        std::cout << "The log has no population in it." << std::endl;
+        return true;
+    }
+
+    std::cout << "Generations " << first_generation << " to " << reader.generation() << " (" << matings << " matings, from "
+              << starts << ((starts == 1) ? " start" : " starts or resumes") << ")" << std::endl;
+
+    std::cout << "Mutations:";
+    for(unsigned type = 0; type < LineageEdit::NUM_TYPES; ++type)
+        std::cout << (type ? ", " : " ") << edit_counts[type] << " " << EDIT_NAMES[type];
+    std::cout << "\nElitism copies: " << elite_copies << ", programs put in from outside: " << programs_put_in << std::endl;
+
+    std::cout << "\nChildren that beat both their parents:" << std::endl;
+    for(unsigned type = LineageEdit::NUM_TYPES + 1; type-- > 0;)
+    {
+        if(!scored[type])
+            continue;
+
+        std::cout << "    " << ((type == LineageEdit::NUM_TYPES) ? "With crossover alone" : std::string("With ") + EDIT_NAMES[type])
+                  << ": " << improved[type] << " of " << scored[type] << " (" << (100.0 * improved[type] / scored[type]) << "%)"
+                  << std::endl;
+    }
+
+    std::cout << "\nNew best programs";
+    if(milestones_found > milestones.size())
+        std::cout << " (the last " << milestones.size() << " of " << milestones_found << ")";
+    std::cout << ":" << std::endl;
+
+    for(size_t i = 0; i < milestones.size(); ++i)
+    {
+        std::cout << "    Generation " << milestones[i].generation << ": " << milestones[i].score << ", length "
+                  << milestones[i].length << ", " << milestones[i].origin << std::endl;
+    }
+
+    unsigned best = 0;
+    for(unsigned id = 1; id < reader.size(); ++id)
+    {
+        if(reader.score(id) > reader.score(best))
+            best = id;
+    }
+
+    std::cout << "\nBest program at the end (scoring " << reader.score(best) << "):\n" << reader.program(best) << std::endl;
+
+    return true;
+}
+
+
+/* Gathers up where the run has got to, for the telemetry. Every program must have been scored.
+   The means take a look at every program, which is why records are only made every so often. */
+TelemetryRecord make_telemetry_record(const Population &population, unsigned long generations, double seconds)
+{
+    TelemetryRecord record;
+    double total_score = 0;
+    double total_length = 0;
+
+    for(unsigned id = 0; id < population.size(); ++id)
+    {
+        total_score += population.score(id);
+        total_length += population.length(id);
+    }
+
+    record.generations = generations;
+    record.seconds = seconds;
+    record.programs_run = programs_run;
+    record.programs_failed = programs_failed;
+    record.programs_timed_out = programs_timed_out;
+    record.cycles = cycles_run;
+    record.best_score = population.score(population.best());
+    record.mean_score = total_score / population.size();
+    record.worst_score = population.score(population.worst());
+    record.mean_length = total_length / population.size();
+
+    return record;
+}
+
+
+/* Reads a config file into a list of options, just as if they had been given on the command line.
+   Each line holds an option's name without its dashes, then its value (if it takes one), with a space or '=' between.
+   For example "pop-size = 100000", or "goal Hello, world!". Blank lines and lines starting with '#' are skipped. */
+bool read_config(const std::string &filename, std::vector<std::string> &options)
+{
+    std::ifstream file(filename.c_str());
+    std::string line;
+
+    if(!file)
+        return false;
+
+    while(std::getline(file, line))
+    {
+        if(!line.empty() && line[line.length() - 1] == '\r')
+            line.erase(line.length() - 1);
+
+        size_t name_start = line.find_first_not_of(" \t");
+
+        if(name_start == std::string::npos || line[name_start] == '#')
+            continue;
+
+        size_t name_end = line.find_first_of(" \t=", name_start);
+        std::string name = line.substr(name_start, name_end - name_start);
+        size_t value_start = (name_end == std::string::npos) ? std::string::npos : line.find_first_not_of(" \t=", name_end);
+
+        // The goal output is given on its own on the command line, rather than after an option.
+        if(name != "goal")
+            options.push_back("--" + name);
+
+        if(value_start != std::string::npos)
+            options.push_back(line.substr(value_start));
+    }
+
+    return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+    Interpreter::Backend backend = Interpreter::BYTECODE;
+    uint64_t seed = time(0);
+    unsigned num_threads = 1;
+    unsigned num_processes = 0;  // 0 means programs are only scored in this process.
+    unsigned num_islands = 0;  // 0 means evolve a single population, as usual.
+    Topology topology = RING;
+    unsigned migration_rate = MIGRATION_RATE;
+    std::string batch_file;  // Empty unless evolving a batch of goals.
+    std::string results_file;
+    unsigned long max_generations = 0;
+    double max_seconds = 0;
+    std::string checkpoint_file;  // Empty unless the run is being checkpointed.
+    unsigned long checkpoint_rate = CHECKPOINT_RATE;
+    CheckpointReader resumed;  // The checkpoint being resumed from, if any.
+    bool resuming = false;
+    std::vector<std::string> run_options;  // The options as given (with those from --config), for checkpoints to start with again.
+    std::string telemetry_file;  // Empty unless telemetry is being written.
+    std::string benchmark_file;  // Empty unless benchmarking.
+    bool self_test = false;
+    std::string lineage_file;  // Empty unless a lineage log is being written.
+    std::string lineage_query_file;  // Empty unless a lineage log is being read.
+    TelemetryReporter::Format telemetry_format = TelemetryReporter::CSV;
+    unsigned long telemetry_rate = TELEMETRY_RATE;
+
+    /* Check if ran from command line.
+       --native runs programs as machine code, and --seed lets runs be repeated to compare the two.
+       --threads scores programs on that many threads (0 for one per core).
+       --processes scores them in that many worker processes instead (0 for one per core), for huge populations.
+       --islands evolves that many populations at once instead (0 for one per core), which share their best programs
+       every --migration-rate generations with their neighbours in the --topology (ring or full).
+       --pop-size, --min-size, --max-size and --mutation-rate change the genetic algorithm's parameters.
+       --cutoff stops programs early once they can't reach that score, or can't beat the worst program ("worst").
+       --tests evolves programs that pass the test cases in a file, rather than ones that output the goal output.
+       --variation brackets makes crossover and mutation keep brackets matched, rather than ignoring them ("random").
+       --canonical caches programs by their canonical form, so ones that only differ in ways that can't matter share a run.
+       --cycle-tiers runs programs with a few cycles first, and only gives more to the ones whose output so far is promising.
+       --generational replaces every program but the best with a child each generation, bred and scored all at once.
+       --batch evolves a program for every goal in a file ("-" for standard input) instead, --threads of them at once,
+       writing the results to --results (standard output by default). Each stops early at --max-generations or
+       --max-seconds, if given.
+       --checkpoint saves the run to a file every --checkpoint-rate generations, which --resume carries it on from.
+       --telemetry writes a record of the run's progress to a file ("-" for standard output, which moves the reports
+       to standard error) every --telemetry-rate generations, as --telemetry-format csv or json (lines).
+       --benchmark times the interpreter, the genetic operators and evolving a few goals instead, writing the results
+       to a file ("-" for standard output) as JSON. Evolving each goal stops at --max-generations or --max-seconds.
+       --lineage records how every program came about in a file, which --lineage-query reads back instead of evolving.
+       --self-test checks that the interpreter's shortcuts don't change how programs run, instead of evolving.
+       --config reads any of these from a file. Options after it (or after --resume) override the file's.
+       Anything else is the goal output, which can only be given once (besides in a file). */
+    std::vector<std::string> args(argv + 1, argv + argc);
+    size_t from_files_end = 0;  // The args before this that came from a file (--config or --resume) rather than the user.
+    bool goal_given = false;  // Whether the user gave a goal output themselves, which they can only do once.
+    std::string given_goal;
+
+    for(size_t i = 0; i < args.size(); ++i)
+    {
+        std::string arg = args[i];
+        bool has_value = (i + 1 < args.size());
+        size_t first = i;
+
+        if(arg == "--native")
+            backend = Interpreter::NATIVE;
+        else if(arg == "--seed" && has_value)
+            seed = strtoull(args[++i].c_str(), NULL, 10);
+        else if(arg == "--threads" && has_value)
+            num_threads = strtoul(args[++i].c_str(), NULL, 10);
+        else if(arg == "--processes" && has_value)
+        {
+            num_processes = strtoul(args[++i].c_str(), NULL, 10);
+            if(!num_processes)
+                num_processes = std::thread::hardware_concurrency();
+        }
+        else if(arg == "--islands" && has_value)
+        {
+            num_islands = strtoul(args[++i].c_str(), NULL, 10);
+            if(!num_islands)
+                num_islands = std::thread::hardware_concurrency();
+        }
+        else if(arg == "--topology" && has_value)
+            topology = (args[++i] == "full") ? FULLY_CONNECTED : RING;
+        else if(arg == "--migration-rate" && has_value)
+            migration_rate = strtoul(args[++i].c_str(), NULL, 10);
+        else if(arg == "--pop-size" && has_value)
+            POP_SIZE = strtoul(args[++i].c_str(), NULL, 10);
+        else if(arg == "--min-size" && has_value)
+            MIN_PROGRAM_SIZE = strtoul(args[++i].c_str(), NULL, 10);
+        else if(arg == "--max-size" && has_value)
+            MAX_PROGRAM_SIZE = strtoul(args[++i].c_str(), NULL, 10);
+        else if(arg == "--mutation-rate" && has_value)
+            MUTATION_RATE = strtod(args[++i].c_str(), NULL);
+        else if(arg == "--cutoff" && has_value)
+        {
+            std::string value = args[++i];
+
+            if(value == "worst")
+                CUTOFF_AT_WORST = true;
+            else
+                FITNESS_CUTOFF = strtod(value.c_str(), NULL);
+        }
+        else if(arg == "--variation" && has_value)
+            BRACKET_AWARE = (args[++i] == "brackets");
+        else if(arg == "--canonical")
+            CANONICAL_KEYS = true;
+        else if(arg == "--cycle-tiers")
+            CYCLE_TIERS = true;
+        else if(arg == "--generational")
+            GENERATIONAL = true;
+        else if(arg == "--tests" && has_value)
+            TEST_FILE = args[++i];
+        else if(arg == "--batch" && has_value)
+            batch_file = args[++i];
+        else if(arg == "--results" && has_value)
+            results_file = args[++i];
+        else if(arg == "--max-generations" && has_value)
+            max_generations = strtoul(args[++i].c_str(), NULL, 10);
+        else if(arg == "--max-seconds" && has_value)
+            max_seconds = strtod(args[++i].c_str(), NULL);
+        else if(arg == "--checkpoint" && has_value)
+            checkpoint_file = args[++i];
+        else if(arg == "--checkpoint-rate" && has_value)
+            checkpoint_rate = strtoul(args[++i].c_str(), NULL, 10);
+        else if(arg == "--telemetry" && has_value)
+            telemetry_file = args[++i];
+        else if(arg == "--telemetry-format" && has_value)
+            telemetry_format = (args[++i] == "json") ? TelemetryReporter::JSON_LINES : TelemetryReporter::CSV;
+        else if(arg == "--telemetry-rate" && has_value)
+            telemetry_rate = strtoul(args[++i].c_str(), NULL, 10);
+        else if(arg == "--benchmark" && has_value)
+            benchmark_file = args[++i];
+        else if(arg == "--lineage" && has_value)
+            lineage_file = args[++i];
+        else if(arg == "--lineage-query" && has_value)
+            lineage_query_file = args[++i];
+        else if(arg == "--self-test")
+            self_test = true;
+        else if(arg == "--resume" && has_value)
+        {
+            std::string filename = args[++i];
+
+            if(!resumed.open(filename))
+            {
+                std::cerr << "Couldn't read checkpoint '" << filename << "'" << std::endl;
+                return 1;
+            }
+
+            // The run starts the way it was first started, then carries on from the checkpoint.
+            args.insert(args.begin() + i + 1, resumed.run().options.begin(), resumed.run().options.end());
+            from_files_end = std::max(from_files_end, i + 1) + resumed.run().options.size();
+            resuming = true;
+        }
+        else if(arg == "--config" && has_value)
+        {
+            std::string filename = args[++i];
+            std::vector<std::string> options;
+
+            if(!read_config(filename, options))
+            {
+                std::cerr << "Couldn't read config file '" << filename << "'" << std::endl;
+                return 1;
+            }
+
+            args.insert(args.begin() + i + 1, options.begin(), options.end());
+            from_files_end = std::max(from_files_end, i + 1) + options.size();
+        }
+        else if(arg.compare(0, 2, "--") == 0)
+        {
+            std::cerr << "'" << arg << "' isn't an option, or is missing its value." << std::endl;
+            return 1;
+        }
+        else if(i >= from_files_end && goal_given)
+        {
+            std::cerr << "Only one goal output can be given, but there's both '" << given_goal << "' and '" << arg << "'."
+                      << std::endl;
+            return 1;
+        }
+        else
+        {
+            GOAL_OUTPUT = arg;
+
+            if(i >= from_files_end)
+            {
+                goal_given = true;
+                given_goal = arg;
+            }
+        }
+
+        // The options a file was read for come next in args, so they're the ones kept rather than the file's name.
+        if(arg != "--config" && arg != "--resume")
+            run_options.insert(run_options.end(), args.begin() + first, args.begin() + i + 1);
+    }
+
+    // Crossover needs programs at least 2 long, and selection needs two different parents.
+    if(POP_SIZE < 2 || MIN_PROGRAM_SIZE < 2 || MIN_PROGRAM_SIZE > MAX_PROGRAM_SIZE || MUTATION_RATE < 0 || MUTATION_RATE > 1)
+    {
+        std::cerr << "The population size must be at least 2, the program sizes at least 2 (with the minimum no more than "
+                  << "the maximum), and the mutation rate from 0 to 1." << std::endl;
+        return 1;
+    }
+
+    if(!TEST_FILE.empty() && !batch_file.empty())
+    {
+        std::cerr << "A batch is a list of goal outputs, so it can't be used with test cases." << std::endl;
+        return 1;
+    }
+
+    if(!TEST_FILE.empty() && !benchmark_file.empty())
+    {
+        std::cerr << "The benchmarks evolve goal outputs of their own, so they can't be used with test cases." << std::endl;
+        return 1;
+    }
+
+    if((!checkpoint_file.empty() || resuming) && (!batch_file.empty() || num_islands))
+    {
+        std::cerr << "Only a single population can be checkpointed, not islands or a batch." << std::endl;
+        return 1;
+    }
+
+    if(!telemetry_file.empty() && (!batch_file.empty() || num_islands))
+    {
+        std::cerr << "Telemetry is only written for a single population, not islands or a batch." << std::endl;
+        return 1;
+    }
+
+    if(!lineage_file.empty() && (!batch_file.empty() || num_islands))
+    {
+        std::cerr << "A lineage log is only written for a single population, not islands or a batch." << std::endl;
+        return 1;
+    }
+
+    if(num_processes && (!batch_file.empty() || num_islands || !benchmark_file.empty()))
+    {
+        std::cerr << "Worker processes only score a single population, not islands, a batch or the benchmarks."
+                  << std::endl;
+        return 1;
+    }
+
+    if(GENERATIONAL && (!batch_file.empty() || num_islands || !lineage_file.empty()))
+    {
+        std::cerr << "Only a single population can be evolved a generation at a time, not islands or a batch, and its "
+                  << "lineage can't be logged (which follows one mating at a time)." << std::endl;
+        return 1;
+    }
+
+    if(!checkpoint_rate || !telemetry_rate)
+    {
+        std::cerr << "The checkpoint and telemetry rates must be at least 1 generation." << std::endl;
+        return 1;
+    }
+
+    // Telemetry sent to standard output gets it to itself, so other programs can read it, and the reports go to stderr.
+    std::ostream &report = (telemetry_file == "-") ? std::cerr : std::cout;
+
+    std::ofstream telemetry_output;
+    if(!telemetry_file.empty() && telemetry_file != "-")
+    {
+        telemetry_output.open(telemetry_file.c_str());
+
+        if(!telemetry_output)
+        {
+            std::cerr << "Couldn't write telemetry to '" << telemetry_file << "'." << std::endl;
+            return 1;
+        }
+    }
+
+    if(!TEST_FILE.empty())
+    {
+        if(!read_tests(TEST_FILE))
+        {
+            std::cerr << "Couldn't read test cases from '" << TEST_FILE << "'. Each line needs an input, a tab, "
+                      << "and the output it should give." << std::endl;
+            return 1;
+        }
+
+        NUM_INSTRUCTIONS = sizeof(INSTRUCTIONS) / sizeof(INSTRUCTIONS[0]);
+    }
+
+    if(!num_threads)
+        num_threads = std::thread::hardware_concurrency();
+
+    if(!lineage_query_file.empty())
+        return query_lineage(lineage_query_file) ? 0 : 1;
+
+    if(self_test)
+        return run_self_tests(seed) ? 0 : 1;
+
+    if(!benchmark_file.empty())
+        return run_benchmarks(benchmark_file, max_generations, max_seconds, backend, seed) ? 0 : 1;
+
+    if(!batch_file.empty())
+        return run_batch(batch_file, results_file, num_threads, max_generations, max_seconds, backend, seed) ? 0 : 1;
+
+    if(num_islands)
+    {
+        run_islands(num_islands, topology, migration_rate, backend, seed);
+        return 0;
+    }
+
+    // The workers are forked before the pool starts any threads, since they would only get copies of this one.
+    EvaluationFarm *farm = num_processes ? new EvaluationFarm(num_processes, backend,
+                                                              TEST_INPUTS.empty() ? calculate_fitness : calculate_test_fitness) : NULL;
+    evaluation_farm = farm;
+
+    // Initialize the brainfuck interpreters and seed random.
+    Interpreter brainfuck(backend);
+    EvaluationPool evaluation_pool(num_threads, backend);
+    FitnessCache fitness_cache(FITNESS_CACHE_SIZE);
+    Random random(seed);
+    random_stream = &random;
+    report << "Seed: " << seed << ", threads: " << evaluation_pool.size();
+    if(farm)
+        report << ", worker processes: " << farm->size();
+    report << std::endl;
+
+    std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();  // Wall time, since clock() adds up every thread.
+
+    Population population(POP_SIZE, MAX_PROGRAM_SIZE);
+
+    bool keep_going = false;  // Just used to have the program keep searching after a match is found.
+
+    unsigned long generations = 0;
+
+    if(resuming)
+    {
+        if(!resumed.restore(population, fitness_cache))
+        {
+            std::cerr << "The checkpoint's population doesn't match --pop-size and --max-size, so it can't be resumed."
+                      << std::endl;
+            delete farm;
+            return 1;
+        }
+
+        const RunState &run = resumed.run();
+
+        generations = run.generations;
+        random.load(run.random_state);
+        elite_cycles = run.elite_cycles;
+        keep_going = run.keep_going;
+        report << "Resuming from generation " << generations << std::endl;
+    }
+    else
+        initialize_population(population);
+
+    // The seed is saved too, even if it wasn't given, so a resumed run reports the one it started with.
+    CheckpointWriter *checkpoint = NULL;
+    if(!checkpoint_file.empty())
+    {
+        checkpoint = new CheckpointWriter(checkpoint_file);
+        run_options.push_back("--seed");
+        run_options.push_back(std::to_string(seed));
+    }
+
+    TelemetryReporter *telemetry = NULL;
+    if(!telemetry_file.empty())
+    {
+        telemetry = new TelemetryReporter(telemetry_output.is_open() ? static_cast<std::ostream &>(telemetry_output) : std::cout,
+                                          telemetry_format, generations);
+    }
+
+    LineageWriter *lineage = NULL;
+    if(!lineage_file.empty())
+    {
+        lineage = new LineageWriter();
+
+        if(!lineage->open(lineage_file, POP_SIZE))
+        {
+            std::cerr << "Couldn't write lineage log '" << lineage_file << "', or it's the log of a different size of "
+                      << "population." << std::endl;
+            delete lineage;
+            delete telemetry;
+            delete checkpoint;
+            delete farm;
+            return 1;
+        }
+
+        lineage->population(generations, population);
+        lineage_log = lineage;
+    }
+
+    // A whole generation breeds about as many children as DISPLAY_RATE matings would, so reports come as often.
+    unsigned long display_rate = GENERATIONAL ? std::max(1u, DISPLAY_RATE / (POP_SIZE / NUM_CHILDREN)) : DISPLAY_RATE;
+
+    // How many programs run (and failed) had already been reported, so each report only shows the ones since.
+    unsigned long reported_run = 0;
+    unsigned long reported_failed = 0;
+
+    // And now we just repeat the process of selection and reproduction over and over again.
+    while(1)
+    {
+        if(GENERATIONAL)
+            breed_generation(population, evaluation_pool, fitness_cache);
+        else
+            evolve_generation(population, evaluation_pool, fitness_cache);
+
+        // Report on the current best program every so often.
+        if(!(generations % display_rate))
+        {
+            // The children are scored now rather than at the start of the next generation, so they count towards the best.
+            score_population(population, evaluation_pool, fitness_cache);
+            std::string best_program = population.program_string(population.best());
+
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+            report << "\n\nGeneration " << generations;
+            if(generations && elapsed > 0)
+                report << " (" << static_cast<unsigned long>(generations / elapsed) << " per second)";
+
+            // Show how many evaluations the cache saved since the last report.
+            unsigned long lookups = fitness_cache.hits() + fitness_cache.misses();
+            if(lookups)
+            {
+                report << "\nFitness cache: " << fitness_cache.hits() << " hits, " << fitness_cache.misses() << " misses ("
+                          << (100.0 * fitness_cache.hits() / lookups) << "% of evaluations skipped)";
+                fitness_cache.reset_counters();
+            }
+
+            // And how many of the programs that were run only failed.
+            if(programs_run > reported_run)
+            {
+                unsigned long run = programs_run - reported_run;
+                unsigned long failed = programs_failed - reported_failed;
+
+                report << "\nErrors: " << failed << " of " << run << " programs run (" << (100.0 * failed / run) << "%)";
+                reported_run += run;
+                reported_failed += failed;
+            }
+
+            report_cycle_tiers(report);
+            report_profile(report);
+
+            report << "\nBest program evolved so far: " << std::endl;
+            report << best_program << std::endl;
+
+            bool solved;
+
+            if(TEST_INPUTS.empty())
+            {
+                std::string output = brainfuck.run(best_program);
+                report << "\nOutput: " << output << std::endl;
+                solved = (output == GOAL_OUTPUT);
+            }
+            else
+            {
+                size_t passes = count_passes(brainfuck, best_program);
+                report << "\nPasses " << passes << " of " << TEST_INPUTS.size() << " test cases" << std::endl;
+                solved = (passes == TEST_INPUTS.size());
+            }
+
+            if(solved && !keep_going)
+            {
+                report << "\n\a\a\aProgram evolved!" << std::endl;
+
+                // Shorten it straight away, on every core, rather than waiting for evolution to.
+                std::chrono::steady_clock::time_point minimize_start = std::chrono::steady_clock::now();
+                std::string minimized = minimize_program(best_program, std::max(1u, std::thread::hardware_concurrency()), backend);
+                double minimize_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - minimize_start).count();
+
+                report << "Minimized from " << best_program.length() << " to " << minimized.length() << " characters in "
+                          << minimize_seconds << " seconds:" << std::endl;
+                report << minimized << std::endl;
+
+                // Evolution carries on from the shorter program, if asked to.
+                best_program = minimized;
+                if(!population.contains(best_program.data(), best_program.length()))
+                {
+                    unsigned worst = population.worst();
+
+                    population.set_program(worst, best_program.data(), best_program.length());
+                    if(lineage_log)
+                        lineage_log->program(worst, best_program.data(), best_program.length());
+                }
+
+                report << "Save source code as a text file? (y/n) ";
+
+                char answer;
+                std::cin >> answer;
+
+                if(answer == 'y')
+                {
+                    std::ofstream srcfile("bfsrc.txt");
+                    srcfile << (TEST_INPUTS.empty() ? GOAL_OUTPUT : "Test cases in " + TEST_FILE) << ":\n\n" << best_program;
+                    report << "Source code saved as 'bfsrc.txt'\n" << std::endl;
+                }
+
+                //std::cout << "It took roughly " << generations << " generations to evolve this program." << std::endl;
+                report << "Keep evolving for more efficiency? (y/n) ";
+                std::cin >> answer;
+
+                // Quit the program if the user doesn't want to continue.
+                if(answer != 'y')
+                {
+                    delete lineage;
+                    delete telemetry;
+                    delete checkpoint;
+                    delete farm;
+                    return 0;
+                }
+
+                keep_going = true;
             }
         }
 
         ++generations;
+
+        // Like checkpoints (below), scoring the children first doesn't change how the run goes.
+        if(telemetry && !(generations % telemetry_rate))
+        {
+            score_population(population, evaluation_pool, fitness_cache);
+
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+            telemetry->post(make_telemetry_record(population, generations, elapsed));
+        }
+
+        /* The children are scored before the run is saved, which the next generation would have done first anyway,
+           so a run carries on the same whether or not it was saved. */
+        if(checkpoint && !(generations % checkpoint_rate))
+        {
+            score_population(population, evaluation_pool, fitness_cache);
+
+            RunState run;
+            run.options = run_options;
+            run.generations = generations;
+            random.save(run.random_state);
+            run.elite_cycles = elite_cycles;
+            run.keep_going = keep_going;
+
+            checkpoint->save(run, population, fitness_cache);
+        }
     }
 
     return 0;
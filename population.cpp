@@ -0,0 +1,328 @@
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+#include "interpreter.h"
+#include "fitness_cache.h"
+#include "population.h"
+
+Population::Population(unsigned size, unsigned max_program_size)
+    : slot_size(max_program_size), arena(2 * static_cast<size_t>(size) * max_program_size), lengths(2 * size, 0),
+      current(size, 0), score_list(size, 0), snapshot_list(size), leaves(1), is_unscored(size, false)
+{
+    while(this->leaves < size)
+        this->leaves *= 2;
+
+    this->totals.assign(2 * this->leaves, 0);
+    this->best_ids.assign(2 * this->leaves, -1);
+    this->worst_ids.assign(2 * this->leaves, -1);
+
+    this->copies.resize(2 * this->leaves);
+    this->copy_mask = this->copies.size() - 1;
+    this->count_copy(NULL, 0, size);
+
+    this->unscored_ids.reserve(size);
+
+    for(unsigned i = 0; i < size; ++i)
+    {
+        this->best_ids[this->leaves + i] = i;
+        this->worst_ids[this->leaves + i] = i;
+        this->update_tree(i);
+        this->mark_unscored(i);
+    }
+}
+
+unsigned Population::size() const
+{
+    return this->score_list.size();
+}
+
+unsigned Population::max_length() const
+{
+    return this->slot_size;
+}
+
+const char *Population::program(unsigned id) const
+{
+    return this->slot(id, this->current[id]);
+}
+
+unsigned Population::length(unsigned id) const
+{
+    return this->lengths[2 * id + this->current[id]];
+}
+
+std::string Population::program_string(unsigned id) const
+{
+    return std::string(this->program(id), this->length(id));
+}
+
+const char *Population::previous_program(unsigned id) const
+{
+    return this->slot(id, !this->current[id]);
+}
+
+unsigned Population::previous_length(unsigned id) const
+{
+    return this->lengths[2 * id + !this->current[id]];
+}
+
+char *Population::new_program(unsigned id)
+{
+    return this->slot(id, !this->current[id]);
+}
+
+void Population::finish_program(unsigned id, unsigned length)
+{
+    this->count_copy(this->program(id), this->length(id), -1);
+
+    this->current[id] = !this->current[id];
+    this->lengths[2 * id + this->current[id]] = length;
+
+    this->count_copy(this->program(id), length, 1);
+    this->mark_unscored(id);
+}
+
+// The program may be one of the population's own, even the very one in the spare slot.
+void Population::set_program(unsigned id, const char *program, unsigned length)
+{
+    memmove(this->new_program(id), program, length);
+    this->finish_program(id, length);
+}
+
+bool Population::contains(const char *program, unsigned length) const
+{
+    return this->copies[this->find_copies(FitnessCache::key_for(program, length).hash)].count != 0;
+}
+
+double Population::score(unsigned id) const
+{
+    return this->score_list[id];
+}
+
+void Population::set_score(unsigned id, double score)
+{
+    this->score_list[id] = score;
+    this->update_tree(id);
+}
+
+const std::vector<unsigned> &Population::unscored() const
+{
+    return this->unscored_ids;
+}
+
+void Population::clear_unscored()
+{
+    for(size_t i = 0; i < this->unscored_ids.size(); ++i)
+        this->is_unscored[this->unscored_ids[i]] = false;
+
+    this->unscored_ids.clear();
+}
+
+Interpreter::Snapshot &Population::snapshot(unsigned id)
+{
+    return this->snapshot_list[id];
+}
+
+void Population::swap_snapshots(unsigned id1, unsigned id2)
+{
+    std::swap(this->snapshot_list[id1], this->snapshot_list[id2]);
+}
+
+double *Population::scores()
+{
+    return this->score_list.data();
+}
+
+unsigned Population::best() const
+{
+    return this->best_ids[1];
+}
+
+unsigned Population::worst() const
+{
+    return this->worst_ids[1];
+}
+
+/* Walks down from the root, going left if the random number falls within the total score on the left and right
+   otherwise (taking off the left's total as it goes). The other parent is left out by zeroing its score for a moment. */
+unsigned Population::select(double random, int other_parent)
+{
+    double other_score = (other_parent >= 0) ? this->score_list[other_parent] : 0;
+
+    if(other_parent >= 0)
+        this->set_score(other_parent, 0);
+
+    unsigned id;
+
+    if(this->totals[1] > 0)
+    {
+        double target = random * this->totals[1];
+        unsigned node = 1;
+
+        while(node < this->leaves)
+        {
+            unsigned left = 2 * node;
+
+            // Floating-point error can leave the target just past the last total, so never go right into nothing.
+            if(target < this->totals[left] || this->totals[left + 1] <= 0)
+                node = left;
+            else
+            {
+                target -= this->totals[left];
+                node = left + 1;
+            }
+        }
+
+        id = node - this->leaves;
+    }
+    else
+    {
+        // Nothing has a score worth anything, so every program gets the same chance.
+        id = static_cast<unsigned>(random * this->size()) % this->size();
+
+        if(static_cast<int>(id) == other_parent)
+            id = (id + 1) % this->size();
+    }
+
+    if(other_parent >= 0)
+        this->set_score(other_parent, other_score);
+
+    return id;
+}
+
+void Population::update_scores(const std::vector<unsigned> &ids)
+{
+    unsigned depth = 0;
+    for(unsigned nodes = this->leaves; nodes > 1; nodes /= 2)
+        ++depth;
+
+    // Walking up from each program visits depth nodes apiece, so once that adds up to more than the whole tree, rebuild it.
+    if(static_cast<size_t>(ids.size()) * depth <= 2 * static_cast<size_t>(this->leaves))
+    {
+        for(size_t i = 0; i < ids.size(); ++i)
+            this->update_tree(ids[i]);
+    }
+    else
+        this->rebuild_tree();
+}
+
+void Population::update_tree(unsigned id)
+{
+    unsigned node = this->leaves + id;
+    double score = this->score_list[id];
+
+    this->totals[node] = (score > 0) ? score : 0;
+
+    for(node /= 2; node; node /= 2)
+    {
+        unsigned left = 2 * node;
+
+        this->totals[node] = this->totals[left] + this->totals[left + 1];
+        this->best_ids[node] = this->better(this->best_ids[left], this->best_ids[left + 1]);
+        this->worst_ids[node] = this->worse(this->worst_ids[left], this->worst_ids[left + 1]);
+    }
+}
+
+/* Every node is worked out from its two children just as update_tree() does, so the tree ends up exactly the same.
+   Each level only depends on the one below it, which makes the totals a plain loop over arrays that can be vectorized. */
+void Population::rebuild_tree()
+{
+    double *totals = &this->totals[0];
+    const double *scores = &this->score_list[0];
+    unsigned size = this->size();
+
+    for(unsigned id = 0; id < size; ++id)
+        totals[this->leaves + id] = (scores[id] > 0) ? scores[id] : 0;
+
+    for(unsigned first = this->leaves / 2; first; first /= 2)
+    {
+        for(unsigned node = first; node < 2 * first; ++node)
+            totals[node] = totals[2 * node] + totals[2 * node + 1];
+
+        for(unsigned node = first; node < 2 * first; ++node)
+        {
+            this->best_ids[node] = this->better(this->best_ids[2 * node], this->best_ids[2 * node + 1]);
+            this->worst_ids[node] = this->worse(this->worst_ids[2 * node], this->worst_ids[2 * node + 1]);
+        }
+    }
+}
+
+int Population::better(int a, int b) const
+{
+    if(a < 0)
+        return b;
+    if(b < 0)
+        return a;
+
+    return (this->score_list[b] > this->score_list[a]) ? b : a;
+}
+
+int Population::worse(int a, int b) const
+{
+    if(a < 0)
+        return b;
+    if(b < 0)
+        return a;
+
+    return (this->score_list[b] < this->score_list[a]) ? b : a;
+}
+
+char *Population::slot(unsigned id, unsigned which)
+{
+    return &this->arena[(2 * static_cast<size_t>(id) + which) * this->slot_size];
+}
+
+const char *Population::slot(unsigned id, unsigned which) const
+{
+    return &this->arena[(2 * static_cast<size_t>(id) + which) * this->slot_size];
+}
+
+size_t Population::find_copies(uint64_t hash) const
+{
+    size_t index = hash & this->copy_mask;
+
+    while(this->copies[index].count && this->copies[index].hash != hash)
+        index = (index + 1) & this->copy_mask;
+
+    return index;
+}
+
+void Population::count_copy(const char *program, unsigned length, int amount)
+{
+    uint64_t hash = FitnessCache::key_for(program, length).hash;
+    size_t index = this->find_copies(hash);
+
+    this->copies[index].hash = hash;
+    this->copies[index].count += amount;
+
+    if(this->copies[index].count)
+        return;
+
+    /* Emptying a slot can break the chain of slots a later hash was found through, so move any such hashes back
+       into the gap until the chain reaches an empty slot. */
+    size_t gap = index;
+
+    for(size_t next = (gap + 1) & this->copy_mask; this->copies[next].count; next = (next + 1) & this->copy_mask)
+    {
+        size_t home = this->copies[next].hash & this->copy_mask;
+
+        // Only move it if its home slot isn't between the gap and where it is now (going around the end if need be).
+        if(((next - home) & this->copy_mask) >= ((next - gap) & this->copy_mask))
+        {
+            this->copies[gap] = this->copies[next];
+            this->copies[next].count = 0;
+            gap = next;
+        }
+    }
+}
+
+void Population::mark_unscored(unsigned id)
+{
+    if(this->is_unscored[id])
+        return;
+
+    this->is_unscored[id] = true;
+    this->unscored_ids.push_back(id);
+}
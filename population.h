@@ -0,0 +1,118 @@
+/*************************************************************************************************************
+ * Population                                                                                                *
+ *                                                                                                           *
+ * Holds every program in the population, each known by its index (its ID), along with its fitness score.   *
+ * Built so that populations of hundreds of thousands of programs can be evolved a couple of children at a   *
+ * time without anything having to look through the whole population, or allocate any memory:               *
+ *                                                                                                           *
+ *      -Programs live in one big block of memory (the arena), each in a fixed-size slot big enough for the  *
+ *       longest program allowed. Every program has two slots: the one it is in, and a spare that its        *
+ *       replacement gets written into. Once it is written the two swap, which leaves the old program in the *
+ *       spare slot until it is replaced in turn.                                                            *
+ *      -The scores are kept in a tree where each node holds the total score of the programs below it, along *
+ *       with which of them scored best and worst. Changing a score, roulette selection, and finding the     *
+ *       best and worst programs each only walk one path down (or up) the tree. When most of the scores      *
+ *       change at once (as when a whole generation is bred), the tree is rebuilt a level at a time instead. *
+ *      -How many copies of each program there are is kept in a hash table, so checking whether a program   *
+ *       exists doesn't mean comparing it against every other one.                                           *
+ *      -Programs that have changed since they were last scored are listed, so only they need scoring again. *
+ *************************************************************************************************************/
+
+#ifndef POPULATION_H
+#define POPULATION_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "interpreter.h"
+
+class Population
+{
+private:
+    // A slot in the table of copies. A count of 0 means the slot is empty.
+    struct CopyCount
+    {
+        uint64_t hash;
+        unsigned count;
+    };
+
+    unsigned slot_size;  // The longest a program can be.
+    std::vector<char> arena;  // Program n's two slots are slots 2n and 2n + 1.
+    std::vector<unsigned> lengths;  // The length of the program in each slot.
+    std::vector<unsigned char> current;  // Which of its two slots (0 or 1) each program is in.
+
+    std::vector<double> score_list;
+    std::vector<Interpreter::Snapshot> snapshot_list;  // Checkpoints from running each program, for its children to resume from.
+
+    /* The score tree. Node 1 is the root, the children of node n are 2n and 2n + 1, and the leaves start at
+       'leaves' (the population size rounded up to a power of two). Leaves past the end of the population are empty. */
+    unsigned leaves;
+    std::vector<double> totals;  // The total of the (non-negative) scores under each node. Roulette selection uses these.
+    std::vector<int> best_ids;  // The best program under each node, favouring lower IDs on ties. -1 if there are none.
+    std::vector<int> worst_ids;  // The worst.
+
+    // How many of each program there are, by the hash of their source. Open addressing, with room for twice the population.
+    std::vector<CopyCount> copies;
+    uint64_t copy_mask;
+
+    std::vector<unsigned> unscored_ids;
+    std::vector<bool> is_unscored;
+
+    char *slot(unsigned id, unsigned which);
+    const char *slot(unsigned id, unsigned which) const;
+    void update_tree(unsigned id);  // Recomputes the nodes above a program after its score changes.
+    void rebuild_tree();  // Recomputes every node, from the leaves up.
+    int better(int a, int b) const;  // Whichever of two programs scored higher (or a, on a tie). Either may be -1.
+    int worse(int a, int b) const;
+    size_t find_copies(uint64_t hash) const;  // The slot in copies for a hash, or the empty one where it would go.
+    void count_copy(const char *program, unsigned length, int amount);
+    void mark_unscored(unsigned id);
+
+public:
+    // Starts with size empty programs, all unscored, each with room to grow up to max_program_size.
+    Population(unsigned size, unsigned max_program_size);
+
+    unsigned size() const;
+    unsigned max_length() const;  // The longest a program can be.
+
+    const char *program(unsigned id) const;  // A program's source. Not null-terminated.
+    unsigned length(unsigned id) const;
+    std::string program_string(unsigned id) const;  // A copy of a program's source, for where speed doesn't matter.
+
+    // The program this one replaced, which stays around until it is replaced in turn.
+    const char *previous_program(unsigned id) const;
+    unsigned previous_length(unsigned id) const;
+
+    /* Replacing a program is done by writing its replacement straight into the spare slot returned by new_program(),
+       which has room for max_program_size characters, and then calling finish_program(). Until then the current
+       program can still be read. The replacement is left to be scored again. */
+    char *new_program(unsigned id);
+    void finish_program(unsigned id, unsigned length);
+    void set_program(unsigned id, const char *program, unsigned length);  // Replaces a program with a copy of another.
+
+    bool contains(const char *program, unsigned length) const;
+
+    double score(unsigned id) const;
+    void set_score(unsigned id, double score);
+
+    // Programs replaced since they were last scored (each listed once). Setting a program's score doesn't remove it.
+    const std::vector<unsigned> &unscored() const;
+    void clear_unscored();
+
+    Interpreter::Snapshot &snapshot(unsigned id);
+    void swap_snapshots(unsigned id1, unsigned id2);
+
+    // The raw array of scores, for the evaluation pool to write to. Anything written here must be passed on to set_score().
+    double *scores();
+    void update_scores(const std::vector<unsigned> &ids);  // Does the same as set_score() for each of ids, with what's in scores().
+
+    unsigned best() const;  // The ID of the best scoring program (the lowest one on a tie).
+    unsigned worst() const;
+
+    /* Picks a program with a chance proportional to its score, using a random number from 0 to 1.
+       Programs with no score above zero are never picked, unless none have one. The other parent, if given, is never picked. */
+    unsigned select(double random, int other_parent = -1);
+
+};
+
+#endif
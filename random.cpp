@@ -0,0 +1,115 @@
+#include <cmath>
+#include <cassert>
+#include <stdint.h>
+#include "random.h"
+
+static inline uint64_t rotate_left(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+Random::Random(uint64_t seed)
+{
+    // splitmix64, which turns even similar seeds (like 1, 2, 3...) into unrelated states.
+    for(int i = 0; i < 4; ++i)
+    {
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        this->state[i] = z ^ (z >> 31);
+    }
+}
+
+uint64_t Random::next()
+{
+    uint64_t result = rotate_left(this->state[1] * 5, 7) * 9;
+    uint64_t t = this->state[1] << 17;
+
+    this->state[2] ^= this->state[0];
+    this->state[3] ^= this->state[1];
+    this->state[1] ^= this->state[2];
+    this->state[0] ^= this->state[3];
+    this->state[2] ^= t;
+    this->state[3] = rotate_left(this->state[3], 45);
+
+    return result;
+}
+
+// The top 53 bits make a double with every bit of its fraction random.
+double Random::uniform()
+{
+    return (this->next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Throws away numbers from the top of the range that would make some results more likely than others,
+   which hardly ever happens unless bound is huge. */
+uint64_t Random::below(uint64_t bound)
+{
+    assert(bound > 0);
+
+    uint64_t threshold = -bound % bound;
+    uint64_t x;
+
+    do
+        x = this->next();
+    while(x < threshold);
+
+    return x % bound;
+}
+
+unsigned Random::geometric(double chance, unsigned limit)
+{
+    if(chance >= 1)
+        return 0;
+    if(chance <= 0)
+        return limit;
+
+    // log1p keeps this accurate for the tiny chances mutation rates usually are.
+    double skip = std::floor(std::log1p(-this->uniform()) / std::log1p(-chance));
+
+    return (skip < limit) ? static_cast<unsigned>(skip) : limit;
+}
+
+Random Random::split()
+{
+    Random stream = *this;
+    this->jump();
+
+    return stream;
+}
+
+void Random::save(uint64_t saved[4]) const
+{
+    for(int i = 0; i < 4; ++i)
+        saved[i] = this->state[i];
+}
+
+void Random::load(const uint64_t saved[4])
+{
+    for(int i = 0; i < 4; ++i)
+        this->state[i] = saved[i];
+}
+
+void Random::jump()
+{
+    static const uint64_t JUMP[] = {0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL, 0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL};
+    uint64_t jumped[4] = {0, 0, 0, 0};
+
+    for(int i = 0; i < 4; ++i)
+    {
+        for(int b = 0; b < 64; ++b)
+        {
+            if(JUMP[i] & (1ULL << b))
+            {
+                for(int j = 0; j < 4; ++j)
+                    jumped[j] ^= this->state[j];
+            }
+
+            this->next();
+        }
+    }
+
+    for(int i = 0; i < 4; ++i)
+        this->state[i] = jumped[i];
+}
@@ -0,0 +1,46 @@
+/*************************************************************************************************************
+ * Random Number Generator                                                                                   *
+ *                                                                                                           *
+ * A fast, seedable source of random numbers to use instead of rand(), which is slow, shared by the whole    *
+ * program (so threads can't each have their own), and biased when its result is taken modulo a range.       *
+ *                                                                                                           *
+ *      -Numbers come from xoshiro256** (by David Blackman and Sebastiano Vigna). Its 256 bits of state are  *
+ *       filled from the 64-bit seed with splitmix64, as its authors recommend.                              *
+ *      -split() hands out a new generator that starts 2^128 numbers further along the sequence, so threads  *
+ *       can each be given their own stream that will never overlap with any other.                          *
+ *      -The same seed always gives the same numbers, on any platform.                                       *
+ *************************************************************************************************************/
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+class Random
+{
+private:
+    uint64_t state[4];
+
+    void jump();  // Moves the generator 2^128 numbers ahead.
+
+public:
+    explicit Random(uint64_t seed);
+
+    uint64_t next();  // A random 64-bit number.
+    double uniform();  // A random number from 0 up to (but not including) 1.
+    // A random number from 0 up to (but not including) bound, without any bias. The bound must be at least 1.
+    uint64_t below(uint64_t bound);
+
+    /* The number of failures before the next success, in a run of trials that each succeed with the given chance.
+       Used to skip straight to the next mutation instead of rolling for every instruction. Capped at limit. */
+    unsigned geometric(double chance, unsigned limit);
+
+    Random split();  // Returns a generator for this one's current stream, and moves this one on to the next stream.
+
+    // The generator's whole state, so a run can be saved and carried on from exactly where it was.
+    void save(uint64_t saved[4]) const;
+    void load(const uint64_t saved[4]);
+
+};
+
+#endif
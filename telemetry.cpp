@@ -0,0 +1,98 @@
+#include <iostream>
+#include <deque>
+#include <cstring>
+#include "telemetry.h"
+
+TelemetryReporter::TelemetryReporter(std::ostream &output, Format format, unsigned long first_generation)
+    : output(&output), format(format), stopping(false)
+{
+    memset(&this->last, 0, sizeof(this->last));
+    this->last.generations = first_generation;
+
+    if(format == CSV)
+    {
+        *this->output << "generation,seconds,generations_per_second,evaluations_per_second,cycles_per_second,"
+                      << "best_fitness,mean_fitness,worst_fitness,error_rate,timeout_rate,mean_length" << std::endl;
+    }
+
+    this->thread = std::thread(&TelemetryReporter::thread_main, this);
+}
+
+TelemetryReporter::~TelemetryReporter()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->queue_lock);
+        this->stopping = true;
+    }
+
+    this->record_posted.notify_one();
+    this->thread.join();
+}
+
+void TelemetryReporter::post(const TelemetryRecord &record)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->queue_lock);
+        this->queue.push_back(record);
+    }
+
+    this->record_posted.notify_one();
+}
+
+void TelemetryReporter::thread_main()
+{
+    std::unique_lock<std::mutex> lock(this->queue_lock);
+
+    while(1)
+    {
+        while(this->queue.empty() && !this->stopping)
+            this->record_posted.wait(lock);
+
+        if(this->queue.empty())
+            return;
+
+        TelemetryRecord record = this->queue.front();
+        this->queue.pop_front();
+
+        // Only this thread writes, so the loop can go on queueing records in the meantime.
+        lock.unlock();
+        this->write(record);
+        lock.lock();
+    }
+}
+
+void TelemetryReporter::write(const TelemetryRecord &record)
+{
+    double seconds = record.seconds - this->last.seconds;
+    double programs_run = record.programs_run - this->last.programs_run;
+
+    // A record straight after the one before it would otherwise divide by 0.
+    if(seconds <= 0)
+        seconds = 1e-9;
+
+    double generations_per_second = (record.generations - this->last.generations) / seconds;
+    double evaluations_per_second = programs_run / seconds;
+    double cycles_per_second = (record.cycles - this->last.cycles) / seconds;
+    double error_rate = programs_run ? (record.programs_failed - this->last.programs_failed) / programs_run : 0;
+    double timeout_rate = programs_run ? (record.programs_timed_out - this->last.programs_timed_out) / programs_run : 0;
+
+    if(this->format == CSV)
+    {
+        *this->output << record.generations << ',' << record.seconds << ',' << generations_per_second << ','
+                      << evaluations_per_second << ',' << cycles_per_second << ',' << record.best_score << ','
+                      << record.mean_score << ',' << record.worst_score << ',' << error_rate << ',' << timeout_rate << ','
+                      << record.mean_length << std::endl;
+    }
+    else
+    {
+        *this->output << "{\"generation\": " << record.generations << ", \"seconds\": " << record.seconds
+                      << ", \"generations_per_second\": " << generations_per_second
+                      << ", \"evaluations_per_second\": " << evaluations_per_second
+                      << ", \"cycles_per_second\": " << cycles_per_second << ", \"best_fitness\": " << record.best_score
+                      << ", \"mean_fitness\": " << record.mean_score << ", \"worst_fitness\": " << record.worst_score
+                      << ", \"error_rate\": " << error_rate << ", \"timeout_rate\": " << timeout_rate
+                      << ", \"mean_length\": " << record.mean_length << "}" << std::endl;
+    }
+
+    this->last = record;
+}
@@ -0,0 +1,76 @@
+/*************************************************************************************************************
+ * Telemetry                                                                                                 *
+ *                                                                                                           *
+ * Reports on a run as it goes, as one record every so often, for other programs to read: how fast it is     *
+ * going, how good its programs are, and how many of them fail. Written as CSV (with a header line) or as    *
+ * JSON lines.                                                                                               *
+ *                                                                                                           *
+ *      -The evolution loop only gathers up its running totals into a record and queues it. A thread of its  *
+ *       own works out the rates and writes the record out, so the loop never waits on the output.           *
+ *      -Rates are over the time since the record before, so a run that stalls shows it straight away rather *
+ *       than after its averages catch up.                                                                   *
+ *      -Every record is written as soon as it is ready, so the file can be followed while the run goes on.  *
+ *************************************************************************************************************/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <iostream>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Where a run has got to. The counts are totals since the run started, which the reporter turns into rates.
+struct TelemetryRecord
+{
+    unsigned long generations;
+    double seconds;  // Since the run started.
+    unsigned long programs_run;  // Programs run through the interpreter, rather than found in the cache.
+    unsigned long programs_failed;  // Programs run that got the error score.
+    unsigned long programs_timed_out;  // Programs run that used up every cycle they were allowed.
+    unsigned long cycles;  // The cycles the programs run had used by the time they stopped, counting any skipped by resuming.
+    double best_score;
+    double mean_score;
+    double worst_score;
+    double mean_length;  // The average length of the programs in the population.
+};
+
+class TelemetryReporter
+{
+public:
+    enum Format
+    {
+        CSV,
+        JSON_LINES
+    };
+
+private:
+    std::ostream *output;
+    Format format;
+    TelemetryRecord last;  // The record before the one being written, which its rates are worked out from.
+
+    std::mutex queue_lock;  // Guards everything below.
+    std::condition_variable record_posted;
+    std::deque<TelemetryRecord> queue;  // Records posted but not yet written.
+    bool stopping;  // Set when the reporter is destroyed, to tell the thread to write what's left and exit.
+    std::thread thread;
+
+    void thread_main();  // Writes out records as they're posted until the reporter is destroyed.
+    void write(const TelemetryRecord &record);
+
+    // Threads and mutexes can't be copied.
+    TelemetryReporter(const TelemetryReporter &other);
+    TelemetryReporter &operator=(const TelemetryReporter &other);
+
+public:
+    /* Starts the thread, and writes the CSV header if there is one. The output must outlast the reporter.
+       The first record's rates are worked out from the start of the run, at first_generation (0 unless resumed). */
+    TelemetryReporter(std::ostream &output, Format format, unsigned long first_generation);
+    ~TelemetryReporter();  // Writes any records still queued first.
+
+    void post(const TelemetryRecord &record);  // Queues a record to be written, and returns straight away.
+
+};
+
+#endif